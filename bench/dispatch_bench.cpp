@@ -0,0 +1,196 @@
+#include "PBRTParser.h"
+#include <fstream>
+#include <chrono>
+#include <cstdlib>
+
+//
+// dispatch_bench
+// Compares the directive dispatch of the parser, an interned Directive indexing a
+// table of handlers, with the chain of string comparisons it replaced. Both run
+// on the identifiers of a generated scene made of small world directives, and
+// call handlers that only count them, so that the dispatch itself is measured.
+// The whole parsing of the scene is timed too.
+//
+
+typedef void (*BenchHandler)(unsigned long *);
+
+template <Directive D>
+static void count_directive(unsigned long *counts) {
+	counts[(int)D]++;
+}
+
+static void count_unknown(unsigned long *counts) {
+	counts[(int)Directive::Unknown]++;
+}
+
+//
+// string_dispatch
+// The world directive dispatch before the Directive enum.
+//
+static void string_dispatch(std::string_view name, unsigned long *counts) {
+	if (name == "Include")
+		count_directive<Directive::Include>(counts);
+	else if (name == "Translate")
+		count_directive<Directive::Translate>(counts);
+	else if (name == "Transform")
+		count_directive<Directive::Transform>(counts);
+	else if (name == "ConcatTransform")
+		count_directive<Directive::ConcatTransform>(counts);
+	else if (name == "Scale")
+		count_directive<Directive::Scale>(counts);
+	else if (name == "Rotate")
+		count_directive<Directive::Rotate>(counts);
+	else if (name == "LookAt")
+		count_directive<Directive::LookAt>(counts);
+	else if (name == "AttributeBegin")
+		count_directive<Directive::AttributeBegin>(counts);
+	else if (name == "TransformBegin")
+		count_directive<Directive::TransformBegin>(counts);
+	else if (name == "AttributeEnd")
+		count_directive<Directive::AttributeEnd>(counts);
+	else if (name == "TransformEnd")
+		count_directive<Directive::TransformEnd>(counts);
+	else if (name == "Shape")
+		count_directive<Directive::Shape>(counts);
+	else if (name == "ObjectBegin")
+		count_directive<Directive::ObjectBegin>(counts);
+	else if (name == "ObjectInstance")
+		count_directive<Directive::ObjectInstance>(counts);
+	else if (name == "LightSource")
+		count_directive<Directive::LightSource>(counts);
+	else if (name == "AreaLightSource")
+		count_directive<Directive::AreaLightSource>(counts);
+	else if (name == "Material")
+		count_directive<Directive::Material>(counts);
+	else if (name == "MakeNamedMaterial")
+		count_directive<Directive::MakeNamedMaterial>(counts);
+	else if (name == "NamedMaterial")
+		count_directive<Directive::NamedMaterial>(counts);
+	else if (name == "Texture")
+		count_directive<Directive::Texture>(counts);
+	else
+		count_unknown(counts);
+}
+
+//
+// table_dispatch
+// The dispatch of the parser: the lexer interns the identifier, the parser
+// indexes the table of handlers.
+//
+static void table_dispatch(std::string_view name, unsigned long *counts) {
+	static const std::array<BenchHandler, (size_t)Directive::Count> handlers = [] {
+		std::array<BenchHandler, (size_t)Directive::Count> h{};
+		h[(int)Directive::Include] = count_directive<Directive::Include>;
+		h[(int)Directive::Translate] = count_directive<Directive::Translate>;
+		h[(int)Directive::Transform] = count_directive<Directive::Transform>;
+		h[(int)Directive::ConcatTransform] = count_directive<Directive::ConcatTransform>;
+		h[(int)Directive::Scale] = count_directive<Directive::Scale>;
+		h[(int)Directive::Rotate] = count_directive<Directive::Rotate>;
+		h[(int)Directive::LookAt] = count_directive<Directive::LookAt>;
+		h[(int)Directive::AttributeBegin] = count_directive<Directive::AttributeBegin>;
+		h[(int)Directive::TransformBegin] = count_directive<Directive::TransformBegin>;
+		h[(int)Directive::AttributeEnd] = count_directive<Directive::AttributeEnd>;
+		h[(int)Directive::TransformEnd] = count_directive<Directive::TransformEnd>;
+		h[(int)Directive::Shape] = count_directive<Directive::Shape>;
+		h[(int)Directive::ObjectBegin] = count_directive<Directive::ObjectBegin>;
+		h[(int)Directive::ObjectInstance] = count_directive<Directive::ObjectInstance>;
+		h[(int)Directive::LightSource] = count_directive<Directive::LightSource>;
+		h[(int)Directive::AreaLightSource] = count_directive<Directive::AreaLightSource>;
+		h[(int)Directive::Material] = count_directive<Directive::Material>;
+		h[(int)Directive::MakeNamedMaterial] = count_directive<Directive::MakeNamedMaterial>;
+		h[(int)Directive::NamedMaterial] = count_directive<Directive::NamedMaterial>;
+		h[(int)Directive::Texture] = count_directive<Directive::Texture>;
+		return h;
+	}();
+	BenchHandler handler = handlers[(int)lookup_directive(name)];
+	if (handler)
+		handler(counts);
+	else
+		count_unknown(counts);
+}
+
+//
+// write_scene
+// A scene of small directives, the ones whose dispatch weighs the most.
+//
+static void write_scene(const std::string &filename, size_t blocks) {
+	std::ofstream out(filename);
+	out << "LookAt 0 0 5 0 0 0 0 1 0\nCamera \"perspective\"\nWorldBegin\n"
+		"MakeNamedMaterial \"m\" \"string type\" \"matte\"\n";
+	for (size_t i = 0; i < blocks; i++) {
+		out << "AttributeBegin\n"
+			"NamedMaterial \"m\"\n"
+			"Translate 1 2 3\n"
+			"Scale 1 1 1\n"
+			"Rotate 10 0 1 0\n"
+			"TransformBegin\n"
+			"ConcatTransform [ 1 0 0 0 0 1 0 0 0 0 1 0 0 0 0 1 ]\n"
+			"TransformEnd\n"
+			"AttributeEnd\n";
+	}
+	out << "WorldEnd\n";
+}
+
+template <typename Dispatch>
+static double time_dispatch(const std::vector<std::string_view> &names, int rounds, Dispatch dispatch,
+	unsigned long *counts) {
+	auto start = std::chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++)
+		for (auto name : names)
+			dispatch(name, counts);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+int main(int argc, char** argv) {
+	// blocks of 9 directives
+	size_t blocks = argc >= 2 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+	std::string filename = argc >= 3 ? argv[2] : "dispatch_bench.pbrt";
+	const int rounds = 10;
+	write_scene(filename, blocks);
+
+	// the identifiers of the scene, as the lexer gives them
+	PBRTLexer lexer(filename);
+	std::vector<std::string_view> names;
+	try {
+		while (true) {
+			lexer.next_lexeme();
+			if (lexer.currentLexeme.type == LexemeType::IDENTIFIER)
+				names.push_back(lexer.currentLexeme.value);
+		}
+	}
+	catch (const InputEndedException &) {
+	}
+	catch (const PBRTException &ex) {
+		std::cout << ex.what() << std::endl;
+		return 1;
+	}
+
+	unsigned long stringCounts[(int)Directive::Count] = {};
+	unsigned long tableCounts[(int)Directive::Count] = {};
+	double stringTime = time_dispatch(names, rounds, string_dispatch, stringCounts);
+	double tableTime = time_dispatch(names, rounds, table_dispatch, tableCounts);
+	if (!std::equal(stringCounts, stringCounts + (int)Directive::Count, tableCounts)) {
+		std::cout << "The dispatches do not agree." << std::endl;
+		return 1;
+	}
+	double dispatched = (double)names.size() * rounds;
+	printf("Dispatch of %zu directives x %d:\n", names.size(), rounds);
+	printf("  string compares: %.3f s (%.0f directives/s)\n", stringTime, dispatched / std::max(stringTime, 1e-9));
+	printf("  directive table: %.3f s (%.0f directives/s)\n", tableTime, dispatched / std::max(tableTime, 1e-9));
+
+	try {
+		auto start = std::chrono::steady_clock::now();
+		auto parser = PBRTParser(filename);
+		ygl::scene *scn = parser.parse();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		printf("Parsing: %lu directives in %.3f s (%.0f directives/s)\n", parser.get_directive_count(),
+			elapsed.count(), parser.get_directive_count() / std::max(elapsed.count(), 1e-9));
+		delete scn;
+	}
+	catch (const PBRTException &ex) {
+		std::cout << ex.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
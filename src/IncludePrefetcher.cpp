@@ -0,0 +1,281 @@
+#include "IncludePrefetcher.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+//
+// constructor
+//
+IncludePrefetcher::IncludePrefetcher(ThreadPool &pool, size_t maxBytes, size_t maxReady) : pool(pool) {
+	this->maxReady = maxReady ? maxReady : std::max<size_t>(2, pool.size());
+	this->fileBytes = maxBytes / this->maxReady;
+}
+
+namespace {
+
+//
+// IncludeScanner
+// Finds the file names that follow the Include keywords of a scene file. The text
+// is not lexed: it is searched with memchr for keywords, comments and strings,
+// and only comments and strings are skipped, so that the keywords they contain
+// are not taken. Compressed files are inflated while they are scanned.
+//
+class IncludeScanner {
+public:
+	IncludeScanner(const std::string &filename) : input(filename, true) {
+		this->limit = this->input.size();
+	};
+
+	// false at the end of the text
+	bool next_include(std::string &name);
+
+private:
+	InputBuffer input;
+	static constexpr size_t keywordLength = sizeof("Include") - 1;
+	// the text is searched in [pos, limit)
+	size_t pos = 0;
+	size_t limit = 0;
+	// next occurrence at or after pos, valid till the text grows
+	size_t nextKeyword = 0;
+	size_t nextComment = 0;
+	size_t nextQuote = 0;
+
+	size_t find(size_t from, char c) {
+		const char *found = from < this->limit ?
+			(const char *)memchr(this->input.data() + from, c, this->limit - from) : nullptr;
+		return found ? found - this->input.data() : std::string::npos;
+	};
+	size_t next(size_t &cached, char c) {
+		if (cached < this->pos)
+			cached = this->find(this->pos, c);
+		return cached;
+	};
+	// waits for more text, false if there is no more
+	bool extend();
+	// reads the string that follows the keyword at start, false if the text
+	// ends before it is complete
+	bool read_argument(size_t start, std::string &name);
+};
+
+bool IncludeScanner::next_include(std::string &name) {
+	const char *text = this->input.data();
+	while (true) {
+		size_t keyword = this->next(this->nextKeyword, 'I');
+		size_t comment = this->next(this->nextComment, '#');
+		size_t quote = this->next(this->nextQuote, '"');
+		size_t first = std::min(keyword, std::min(comment, quote));
+		if (first == std::string::npos) {
+			// a keyword might be cut at the end of the text seen so far
+			this->pos = std::max(this->pos, this->limit - std::min(this->limit, this->keywordLength - 1));
+			if (!this->extend())
+				return false;
+			continue;
+		}
+		if (first == comment || first == quote) {
+			// skip to the end of the comment or of the string
+			size_t end = this->find(first + 1, first == comment ? '\n' : '"');
+			if (end == std::string::npos) {
+				this->pos = first;
+				if (!this->extend())
+					return false;
+				continue;
+			}
+			this->pos = end + 1;
+			continue;
+		}
+		// identifiers are runs of letters
+		bool isKeyword = keyword + this->keywordLength <= this->limit &&
+			memcmp(text + keyword, "Include", this->keywordLength) == 0 &&
+			(keyword == 0 || !std::isalpha(text[keyword - 1]));
+		if (!isKeyword) {
+			if (keyword + this->keywordLength > this->limit && this->extend())
+				continue;
+			this->pos = keyword + 1;
+			continue;
+		}
+		if (!this->read_argument(keyword, name)) {
+			this->pos = keyword;
+			if (!this->extend())
+				return false;
+			continue;
+		}
+		return true;
+	}
+}
+
+bool IncludeScanner::read_argument(size_t start, std::string &name) {
+	const char *text = this->input.data();
+	name.clear();
+	size_t p = start + this->keywordLength;
+	if (p < this->limit && std::isalpha(text[p])) {
+		// a longer identifier
+		this->pos = p;
+		return true;
+	}
+	while (p < this->limit) {
+		char c = text[p];
+		if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+			p++;
+		else if (c == '#') {
+			p = this->find(p, '\n');
+			if (p == std::string::npos)
+				break;
+		}
+		else if (c == '"') {
+			size_t end = this->find(p + 1, '"');
+			if (end == std::string::npos)
+				break;
+			name.assign(text + p + 1, end - p - 1);
+			this->pos = end + 1;
+			return true;
+		}
+		else {
+			// not a file name: the parser reports the error
+			this->pos = p;
+			return true;
+		}
+	}
+	if (this->input.is_complete() && this->limit == this->input.size()) {
+		// the text ends before the file name
+		this->pos = this->limit;
+		return true;
+	}
+	return false;
+}
+
+bool IncludeScanner::extend() {
+	size_t size = this->input.wait_for(this->limit + (1 << 20));
+	if (size == this->limit)
+		return false;
+	this->limit = size;
+	// the text already scanned is not needed anymore
+	if (this->pos > 0)
+		this->input.release(this->pos - 1);
+	this->nextKeyword = this->nextComment = this->nextQuote = 0;
+	return true;
+}
+
+}
+
+//
+// scan
+// The main file is read by the parser as usual: here its text is only searched
+// for the Include directives.
+//
+void IncludePrefetcher::scan(const std::string &filename) {
+	// the standard input cannot be read twice
+	if (filename == "-")
+		return;
+	this->pool.submit([this, filename]() {
+		std::string path = get_path_and_filename(filename).first;
+		IncludeScanner scanner(filename);
+		std::string included;
+		while (!this->cancelled && scanner.next_include(included))
+			if (!included.empty())
+				this->request(concatenate_paths(path, included));
+	});
+}
+
+//
+// take
+//
+std::shared_ptr<PBRTLexer> IncludePrefetcher::take(const std::string &filename) {
+	std::shared_ptr<Prefetch> job;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		auto it = this->submitted.find(filename);
+		if (it == this->submitted.end()) {
+			auto w = std::find(this->waiting.begin(), this->waiting.end(), filename);
+			if (w != this->waiting.end())
+				this->waiting.erase(w);
+			else
+				this->takenAhead[filename]++;
+			return nullptr;
+		}
+		job = it->second.front();
+		it->second.pop_front();
+		if (it->second.empty())
+			this->submitted.erase(it);
+		this->submittedCount--;
+		while (this->submittedCount < this->maxReady && !this->waiting.empty()) {
+			this->submit(this->waiting.front());
+			this->waiting.pop_front();
+		}
+	}
+	// if no worker started the job yet, it is faster to read the file here.
+	// Jobs dropped by cancel() are claimed already.
+	int expected = Queued;
+	if (job->state.compare_exchange_strong(expected, Claimed) || expected == Claimed)
+		return nullptr;
+	// the lock must not be held here: the job might need it to request
+	// the files it includes.
+	return job->result.get();
+}
+
+//
+// cancel
+// Jobs already running finish their file, but do not request the files it
+// includes.
+//
+void IncludePrefetcher::cancel() {
+	this->cancelled = true;
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->waiting.clear();
+	for (auto &entry : this->submitted) {
+		for (auto &job : entry.second) {
+			int expected = Queued;
+			job->state.compare_exchange_strong(expected, Claimed);
+		}
+	}
+}
+
+//
+// request
+// Called when an Include directive is found.
+//
+void IncludePrefetcher::request(const std::string &filename) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	if (this->cancelled)
+		return;
+	auto it = this->takenAhead.find(filename);
+	if (it != this->takenAhead.end() && it->second > 0) {
+		it->second--;
+		return;
+	}
+	if (this->submittedCount < this->maxReady)
+		this->submit(filename);
+	else
+		this->waiting.push_back(filename);
+}
+
+//
+// submit
+// Must be called holding the lock.
+//
+void IncludePrefetcher::submit(const std::string &filename) {
+	auto job = std::make_shared<Prefetch>();
+	job->result = this->pool.submit([this, job, filename]() -> std::shared_ptr<PBRTLexer> {
+		int expected = Queued;
+		if (this->cancelled || !job->state.compare_exchange_strong(expected, Running))
+			return nullptr;
+		return this->prefetch(filename);
+	});
+	this->submitted[filename].push_back(job);
+	this->submittedCount++;
+}
+
+//
+// prefetch
+// Opens and pre-lexes an included file, then requests the files it includes.
+// Errors opening the file are delivered to the parser by take().
+//
+std::shared_ptr<PBRTLexer> IncludePrefetcher::prefetch(const std::string &filename) {
+	std::shared_ptr<PBRTLexer> lexer(new PBRTLexer(filename, this->cache));
+	lexer->prelex(this->fileBytes);
+	auto &lexemes = lexer->prelexed_lexemes();
+	for (size_t i = 0; i + 1 < lexemes.size(); i++) {
+		if (lexemes[i].directive == Directive::Include && lexemes[i + 1].type == LexemeType::STRING)
+			this->request(concatenate_paths(lexer->path, lexemes[i + 1].str()));
+	}
+	return lexer;
+}
@@ -0,0 +1,75 @@
+#ifndef __INCLUDEPREFETCHER__
+#define __INCLUDEPREFETCHER__
+#include <string>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include "PBRTLexer.h"
+#include "ThreadPool.h"
+
+//
+// IncludePrefetcher
+// Reads and tokenizes the files included by a scene ahead of the parser. The
+// main file is searched on the pool for Include directives; every file
+// found is opened and pre-lexed (see PBRTLexer::prelex) by a pool task, which
+// in turn looks for the Include directives of the file. When the parser meets
+// an Include it takes the pre-lexed lexer for the file, if there is one.
+// Pre-lexed lexers replay exactly the lexemes, positions and errors the file
+// would give if it was read by the parser, so the parsing does not change.
+//
+class IncludePrefetcher {
+public:
+	// at most maxReady files (0 means one per pool thread) are kept ready to be
+	// taken, and they hold at most maxBytes of pre-lexed lexemes altogether: the
+	// rest of each file is read by the parser.
+	IncludePrefetcher(ThreadPool &pool, size_t maxBytes = (size_t)256 << 20, size_t maxReady = 0);
+
+	// lexers are created with this cache (see PBRTLexer). It must be set
+	// before the scan starts.
+	void set_cache(const LexemeCache *cache) { this->cache = cache; };
+
+	// look for the Include directives of the main scene file
+	void scan(const std::string &filename);
+
+	// returns the pre-lexed lexer for an included file, or nullptr if the file
+	// was not prefetched. Errors met opening the file are thrown here.
+	std::shared_ptr<PBRTLexer> take(const std::string &filename);
+
+	// stop the scan of the main file and drop the prefetches not started yet
+	// (e.g. because the parsing failed). take() returns nullptr afterwards.
+	void cancel();
+
+private:
+	ThreadPool &pool;
+	const LexemeCache *cache = nullptr;
+	size_t maxReady;
+	// memory each prefetched file can take
+	size_t fileBytes;
+	std::atomic<bool> cancelled{ false };
+
+	// A prefetch submitted to the pool. The parser can claim it back while it is
+	// still queued, and read the file itself instead of waiting for the workers.
+	enum PrefetchState { Queued, Running, Claimed };
+	struct Prefetch {
+		std::atomic<int> state{ Queued };
+		std::future<std::shared_ptr<PBRTLexer>> result;
+	};
+
+	std::mutex mutex;
+	// submitted prefetches, by file. The same file can be included many times.
+	std::unordered_map<std::string, std::deque<std::shared_ptr<Prefetch>>> submitted;
+	size_t submittedCount = 0;
+	// files to prefetch waiting for room among the submitted ones
+	std::deque<std::string> waiting;
+	// includes taken by the parser before being found by the scan, by file.
+	// When the scan finds them later, they are not prefetched.
+	std::unordered_map<std::string, int> takenAhead;
+
+	void request(const std::string &filename);
+	void submit(const std::string &filename);
+	std::shared_ptr<PBRTLexer> prefetch(const std::string &filename);
+};
+#endif
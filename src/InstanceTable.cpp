@@ -0,0 +1,62 @@
+#include "InstanceTable.h"
+#include <fstream>
+#include <unordered_map>
+#include <charconv>
+#include <stdexcept>
+
+//
+// append_number
+// Shortest representation that reads back to the same value.
+//
+template <typename T>
+static void append_number(std::string &s, T value) {
+	char buf[32];
+	auto res = std::to_chars(buf, buf + sizeof(buf), value);
+	s.append(buf, res.ptr);
+}
+
+//
+// save_instance_table
+// Shape groups are indexed through a map, scenes can have millions of
+// instances.
+//
+void save_instance_table(const std::string &filename, const ygl::scene *scn) {
+	std::ofstream out(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+		throw std::runtime_error("Cannot write instance table " + filename);
+
+	std::unordered_map<const ygl::shape_group *, int> groupIndex;
+	groupIndex.reserve(scn->shapes.size());
+	std::string buffer = "pbrt-instances 1\nshapes ";
+	append_number(buffer, scn->shapes.size());
+	buffer += '\n';
+	for (auto sg : scn->shapes) {
+		groupIndex.insert({ sg, (int)groupIndex.size() });
+		buffer += sg->name;
+		buffer += '\n';
+	}
+	buffer += "instances ";
+	append_number(buffer, scn->instances.size());
+	buffer += '\n';
+	for (auto inst : scn->instances) {
+		auto it = groupIndex.find(inst->shp);
+		if (it == groupIndex.end())
+			throw std::runtime_error("Instance " + inst->name + " refers to a shape group not in the scene");
+		append_number(buffer, it->second);
+		for (int c = 0; c < 4; c++) {
+			for (int k = 0; k < 3; k++) {
+				buffer += ' ';
+				append_number(buffer, inst->frame[c][k]);
+			}
+		}
+		buffer += '\n';
+		if (buffer.size() >= ((size_t)1 << 20)) {
+			out.write(buffer.data(), buffer.size());
+			buffer.clear();
+		}
+	}
+	out.write(buffer.data(), buffer.size());
+	out.close();
+	if (out.fail())
+		throw std::runtime_error("Cannot write instance table " + filename);
+}
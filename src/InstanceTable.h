@@ -0,0 +1,20 @@
+#ifndef __INSTANCETABLE__
+#define __INSTANCETABLE__
+#include <string>
+#include "../yocto/yocto_gl.h"
+
+//
+// save_instance_table
+// Writes the instances of a scene as a text table, to be read next to the
+// obj file: the geometry of every shape group is written once in the obj
+// (as the object with the same name), and each instance only costs a line.
+// Format:
+//     pbrt-instances 1
+//     shapes <number of shape groups>
+//     <name of each shape group, one per line>
+//     instances <number of instances>
+//     <index of the shape group> <frame: x axis, y axis, z axis, origin>
+// Throws std::runtime_error if the file cannot be written.
+//
+void save_instance_table(const std::string &filename, const ygl::scene *scn);
+#endif
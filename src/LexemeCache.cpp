@@ -0,0 +1,263 @@
+#include "LexemeCache.h"
+#include "PBRTLexer.h"
+#include <filesystem>
+#include <cstring>
+#include <cstdio>
+#include <sstream>
+#include <atomic>
+#include <thread>
+
+// identifies the format (and the byte order) of the cache files
+static const char cacheMagic[8] = { 'P', 'B', 'R', 'T', 'L', 'E', 'X', '2' };
+static const uint32_t cacheByteOrder = 0x01020304;
+// bytes of a record before the number and the value
+static const size_t recordHeaderSize = 10;
+// number of records (8), their total size (8) and the magic again
+static const size_t trailerSize = 16 + sizeof(cacheMagic);
+
+template <typename T>
+static void append_bytes(std::string &s, T value) {
+	s.append((const char *)&value, sizeof(T));
+}
+
+template <typename T>
+static T read_bytes(const char *p) {
+	T value;
+	std::memcpy(&value, p, sizeof(T));
+	return value;
+}
+
+// =====================================================================================
+//                           LexemeCacheReader
+// =====================================================================================
+
+//
+// constructor
+//
+LexemeCacheReader::LexemeCacheReader(std::unique_ptr<InputBuffer> buffer, size_t first, size_t last,
+	uint64_t count) : buffer(std::move(buffer)), remaining(count) {
+	this->cursor = this->buffer->data() + first;
+	this->end = this->buffer->data() + last;
+}
+
+//
+// next
+//
+bool LexemeCacheReader::next(Lexeme &lexeme, size_t &endPos) {
+	if (this->corrupted)
+		return false;
+	size_t left = this->end - this->cursor;
+	if (left == 0 && this->remaining == 0)
+		return false;
+	this->corrupted = true;
+	if (left < recordHeaderSize || this->remaining == 0)
+		return false;
+	unsigned char type = (unsigned char)this->cursor[0];
+	unsigned char directive = (unsigned char)this->cursor[1];
+	if (type > LexemeType::SINGLETON || directive >= (unsigned char)Directive::Count)
+		return false;
+	uint32_t length = read_bytes<uint32_t>(this->cursor + 2);
+	size_t numberSize = type == LexemeType::NUMBER ? sizeof(double) : 0;
+	if (left - recordHeaderSize < numberSize + length)
+		return false;
+	this->corrupted = false;
+	this->remaining--;
+	this->lastEnd += read_bytes<uint32_t>(this->cursor + 6);
+	this->cursor += recordHeaderSize;
+	double number = 0;
+	if (numberSize) {
+		number = read_bytes<double>(this->cursor);
+		this->cursor += numberSize;
+	}
+	lexeme = Lexeme((LexemeType)type, std::string_view(this->cursor, length));
+	lexeme.number = number;
+	lexeme.directive = (Directive)directive;
+	this->cursor += length;
+	endPos = this->lastEnd;
+	return true;
+}
+
+//
+// count_array_values
+//
+size_t LexemeCacheReader::count_array_values() const {
+	size_t count = 0;
+	const char *p = this->cursor;
+	while ((size_t)(this->end - p) >= recordHeaderSize) {
+		LexemeType type = (LexemeType)(unsigned char)p[0];
+		if (type == LexemeType::SINGLETON)
+			break;
+		size_t size = recordHeaderSize + read_bytes<uint32_t>(p + 2) + (type == LexemeType::NUMBER ? sizeof(double) : 0);
+		if ((size_t)(this->end - p) < size)
+			break;
+		count++;
+		p += size;
+	}
+	return count;
+}
+
+// =====================================================================================
+//                           LexemeCacheWriter
+// =====================================================================================
+
+//
+// constructor
+// The temporary file has a name of its own, since the same scene file can be
+// read by several lexers at the same time.
+//
+LexemeCacheWriter::LexemeCacheWriter(const std::string &cachePath, const std::string &header) :
+	cachePath(cachePath) {
+	static std::atomic<unsigned int> counter{ 0 };
+	std::stringstream ss;
+	ss << cachePath << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) << "." << counter++ << ".tmp";
+	this->tmpPath = ss.str();
+	this->out.open(this->tmpPath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (this->out.is_open())
+		this->out.write(header.data(), header.size());
+}
+
+LexemeCacheWriter::~LexemeCacheWriter() {
+	if (!this->out.is_open())
+		return;
+	// the text was not read till its end
+	this->out.close();
+	std::error_code err;
+	std::filesystem::remove(this->tmpPath, err);
+}
+
+//
+// append
+//
+void LexemeCacheWriter::append(const Lexeme &lexeme, size_t endPos) {
+	char record[recordHeaderSize + sizeof(double)];
+	record[0] = (char)lexeme.type;
+	record[1] = (char)lexeme.directive;
+	uint32_t length = (uint32_t)lexeme.value.size();
+	uint32_t step = (uint32_t)(endPos - this->lastEnd);
+	std::memcpy(record + 2, &length, sizeof(uint32_t));
+	std::memcpy(record + 6, &step, sizeof(uint32_t));
+	size_t size = recordHeaderSize;
+	if (lexeme.type == LexemeType::NUMBER) {
+		std::memcpy(record + size, &lexeme.number, sizeof(double));
+		size += sizeof(double);
+	}
+	this->buffer.append(record, size);
+	this->buffer.append(lexeme.value.data(), lexeme.value.size());
+	this->lastEnd = endPos;
+	this->count++;
+	this->recordBytes += size + lexeme.value.size();
+	if (this->buffer.size() >= ((size_t)1 << 20))
+		this->flush();
+}
+
+void LexemeCacheWriter::flush() {
+	this->out.write(this->buffer.data(), this->buffer.size());
+	this->buffer.clear();
+}
+
+//
+// commit
+// Moves the temporary file in place of the cache file. A failure only means
+// that the cache is not updated.
+//
+void LexemeCacheWriter::commit() {
+	if (!this->out.is_open())
+		return;
+	append_bytes(this->buffer, this->count);
+	append_bytes(this->buffer, this->recordBytes);
+	this->buffer.append(cacheMagic, sizeof(cacheMagic));
+	this->flush();
+	this->out.close();
+	std::error_code err;
+	if (this->out.fail())
+		std::filesystem::remove(this->tmpPath, err);
+	else if (std::filesystem::rename(this->tmpPath, this->cachePath, err), err)
+		std::filesystem::remove(this->tmpPath, err);
+}
+
+// =====================================================================================
+//                           LexemeCache
+// =====================================================================================
+
+//
+// constructor
+//
+LexemeCache::LexemeCache(const std::string &directory) : directory(directory) {
+	std::error_code err;
+	std::filesystem::create_directories(directory, err);
+}
+
+//
+// cache_path
+// The name is a FNV-1a hash of the absolute path of the scene file.
+//
+std::string LexemeCache::cache_path(const std::string &filename) const {
+	std::error_code err;
+	std::string absPath = std::filesystem::absolute(filename, err).lexically_normal().string();
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : absPath) {
+		hash ^= (unsigned char)c;
+		hash *= 1099511628211ull;
+	}
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.lexc", (unsigned long long)hash);
+	return concatenate_paths(this->directory, name);
+}
+
+//
+// make_header
+//
+std::string LexemeCache::make_header(const std::string &filename) const {
+	std::error_code err;
+	auto size = std::filesystem::file_size(filename, err);
+	if (err)
+		return "";
+	auto mtime = std::filesystem::last_write_time(filename, err);
+	if (err)
+		return "";
+	std::string absPath = std::filesystem::absolute(filename, err).lexically_normal().string();
+	std::string header(cacheMagic, sizeof(cacheMagic));
+	append_bytes(header, cacheByteOrder);
+	append_bytes(header, (uint64_t)size);
+	append_bytes(header, (int64_t)mtime.time_since_epoch().count());
+	append_bytes(header, (uint32_t)absPath.size());
+	header += absPath;
+	return header;
+}
+
+//
+// open
+// The cache file is used only if its trailer is complete and accounts for all
+// the bytes between the header and itself.
+//
+std::unique_ptr<LexemeCacheReader> LexemeCache::open(const std::string &filename) const {
+	std::string header = this->make_header(filename);
+	if (header.empty())
+		return nullptr;
+	std::unique_ptr<InputBuffer> buffer(new InputBuffer(this->cache_path(filename)));
+	size_t size = buffer->size();
+	if (!buffer->is_open() || size < header.size() + trailerSize ||
+		std::memcmp(buffer->data(), header.data(), header.size()) != 0)
+		return nullptr;
+	const char *trailer = buffer->data() + size - trailerSize;
+	uint64_t count = read_bytes<uint64_t>(trailer);
+	uint64_t recordBytes = read_bytes<uint64_t>(trailer + 8);
+	if (std::memcmp(trailer + 16, cacheMagic, sizeof(cacheMagic)) != 0 ||
+		recordBytes != size - trailerSize - header.size())
+		return nullptr;
+	return std::unique_ptr<LexemeCacheReader>(new LexemeCacheReader(std::move(buffer), header.size(),
+		size - trailerSize, count));
+}
+
+//
+// create
+//
+std::unique_ptr<LexemeCacheWriter> LexemeCache::create(const std::string &filename) const {
+	std::string header = this->make_header(filename);
+	if (header.empty())
+		return nullptr;
+	std::unique_ptr<LexemeCacheWriter> writer(new LexemeCacheWriter(this->cache_path(filename), header));
+	if (!writer->is_open())
+		return nullptr;
+	return writer;
+}
@@ -0,0 +1,105 @@
+#ifndef __LEXEMECACHE__
+#define __LEXEMECACHE__
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <memory>
+#include <cstdint>
+#include "utils.h"
+
+class Lexeme;
+
+//
+// LexemeCacheReader
+// Mapped cache file of a scene file. Lexemes are decoded one at a time, in the
+// order they were read from the text; their values are views on the mapping.
+//
+class LexemeCacheReader {
+public:
+	// the records are in [first, last) and there are count of them
+	LexemeCacheReader(std::unique_ptr<InputBuffer> buffer, size_t first, size_t last, uint64_t count);
+
+	// decode the next lexeme and the position of the head after it in the
+	// text. Returns false when the lexemes are finished, or when a record is
+	// not valid (see is_corrupted).
+	bool next(Lexeme &lexeme, size_t &endPos);
+
+	// true if next() met a record that is not valid: the lexemes after the
+	// last one decoded must be read from the text.
+	bool is_corrupted() const { return this->corrupted; }
+
+	// number of lexemes that follow, before the next '[' or ']'
+	size_t count_array_values() const;
+
+private:
+	std::unique_ptr<InputBuffer> buffer;
+	const char *cursor;
+	const char *end;
+	size_t lastEnd = 0;
+	uint64_t remaining;
+	bool corrupted = false;
+};
+
+//
+// LexemeCacheWriter
+// Writes the lexemes of a scene file as they are read. The data goes to a
+// temporary file that replaces the cache file only when commit() is called,
+// i.e. when the whole text has been read without errors: otherwise it is
+// removed.
+//
+class LexemeCacheWriter {
+public:
+	LexemeCacheWriter(const std::string &cachePath, const std::string &header);
+	~LexemeCacheWriter();
+	LexemeCacheWriter(const LexemeCacheWriter &) = delete;
+	LexemeCacheWriter &operator=(const LexemeCacheWriter &) = delete;
+
+	bool is_open() const { return this->out.is_open(); }
+	void append(const Lexeme &lexeme, size_t endPos);
+	void commit();
+
+private:
+	std::string cachePath;
+	std::string tmpPath;
+	std::ofstream out;
+	// records are written to the file in big chunks
+	std::string buffer;
+	size_t lastEnd = 0;
+	uint64_t count = 0;
+	uint64_t recordBytes = 0;
+	void flush();
+};
+
+//
+// LexemeCache
+// Directory holding the lexemes of the scene files already read, so that the
+// next conversions replay them instead of lexing the text again. Every scene
+// file has its own cache file, named after its path, which also records the
+// path, size and modification time of the scene file: a cache file is used
+// only if they did not change.
+// Record of a lexeme: type (1 byte), directive (1), length of the value (4),
+// distance of the head after the lexeme from the previous one (4), the number
+// (8, number lexemes only) and the characters of the value. The records are
+// followed by a trailer with their number and total size, so that a truncated
+// cache file is not taken as the end of the scene file.
+//
+class LexemeCache {
+public:
+	LexemeCache(const std::string &directory);
+
+	// path of the cache file of a scene file
+	std::string cache_path(const std::string &filename) const;
+
+	// returns nullptr if there is no valid cache for the file
+	std::unique_ptr<LexemeCacheReader> open(const std::string &filename) const;
+
+	// starts writing the cache for the file, nullptr if it cannot be created
+	std::unique_ptr<LexemeCacheWriter> create(const std::string &filename) const;
+
+private:
+	std::string directory;
+
+	// header of the cache file of filename, empty if the file is not readable
+	std::string make_header(const std::string &filename) const;
+};
+#endif
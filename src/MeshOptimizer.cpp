@@ -0,0 +1,398 @@
+#include "MeshOptimizer.h"
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+
+//
+// for_each_element_index
+// Calls f on every vertex index used by the elements of a shape.
+//
+template <typename F>
+static void for_each_element_index(ygl::shape *shp, F f) {
+	for (auto &p : shp->points)
+		f(p);
+	for (auto &l : shp->lines)
+		for (int k = 0; k < 2; k++)
+			f(l[k]);
+	for (auto &t : shp->triangles)
+		for (int k = 0; k < 3; k++)
+			f(t[k]);
+	for (auto &q : shp->quads)
+		for (int k = 0; k < 4; k++)
+			f(q[k]);
+	for (auto &b : shp->beziers)
+		for (int k = 0; k < 4; k++)
+			f(b[k]);
+}
+
+//
+// for_each_vertex_buffer
+// Calls f on every per vertex buffer of a shape.
+//
+template <typename F>
+static void for_each_vertex_buffer(ygl::shape *shp, F f) {
+	f(shp->pos);
+	f(shp->norm);
+	f(shp->texcoord);
+	f(shp->texcoord1);
+	f(shp->color);
+	f(shp->radius);
+	f(shp->tangsp);
+}
+
+//
+// close_values
+// True if the floats of two vertex attributes differ at most by epsilon. A
+// zero epsilon means equal values (so 0 and -0 match).
+//
+template <typename T>
+static bool close_values(const T &a, const T &b, float epsilon) {
+	const float *x = (const float *)&a;
+	const float *y = (const float *)&b;
+	for (size_t i = 0; i < sizeof(T) / sizeof(float); i++) {
+		if (!(std::fabs(x[i] - y[i]) <= epsilon))
+			return false;
+	}
+	return true;
+}
+
+//
+// CellTable
+// Open addressing hash table from the cells of the spatial hash to the last
+// representative put in each of them.
+//
+class CellTable {
+public:
+	CellTable(size_t count) {
+		size_t capacity = 16;
+		while (capacity < 2 * count)
+			capacity *= 2;
+		this->keys.resize(capacity);
+		this->heads.resize(capacity, -1);
+		this->mask = capacity - 1;
+	}
+
+	// slot of the cell, empty (head -1) if the cell is not in the table
+	size_t find(uint64_t key) const {
+		size_t i = (size_t)(key * 0x9E3779B97F4A7C15ull >> 20) & this->mask;
+		while (this->heads[i] >= 0 && this->keys[i] != key)
+			i = (i + 1) & this->mask;
+		return i;
+	}
+
+	std::vector<uint64_t> keys;
+	std::vector<int> heads;
+
+private:
+	size_t mask;
+};
+
+//
+// cell_key
+//
+static uint64_t cell_key(const int64_t cell[3]) {
+	uint64_t key = 14695981039346656037ull;
+	for (int k = 0; k < 3; k++) {
+		key = (key ^ (uint64_t)cell[k]) * 1099511628211ull;
+		key ^= key >> 29;
+	}
+	return key;
+}
+
+//
+// weld_vertices
+// The representatives of the groups are kept in a spatial hash whose cells are
+// twice epsilon wide: on each axis, a vertex can only be welded to the
+// representatives of its cell and of the neighbour on the nearest side, so 8
+// cells are searched at most.
+//
+size_t weld_vertices(ygl::shape *shp, float epsilon) {
+	size_t nverts = shp->pos.size();
+	if (nverts == 0 || !shp->quads_pos.empty() || !shp->quads_norm.empty() ||
+		!shp->quads_texcoord.empty())
+		return 0;
+	// every buffer must have one value per vertex
+	bool consistent = true;
+	size_t vertexBytes = 0;
+	for_each_vertex_buffer(shp, [&](auto &buffer) {
+		if (!buffer.empty()) {
+			consistent = consistent && buffer.size() == nverts;
+			vertexBytes += sizeof(buffer[0]);
+		}
+	});
+	if (!consistent)
+		return 0;
+
+	std::vector<char> used(nverts, 0);
+	bool valid = true;
+	for_each_element_index(shp, [&](int &v) {
+		if (v < 0 || (size_t)v >= nverts)
+			valid = false;
+		else
+			used[v] = 1;
+	});
+	if (!valid)
+		return 0;
+
+	auto same_vertex = [shp, epsilon](int a, int b) {
+		bool same = true;
+		for_each_vertex_buffer(shp, [&](auto &buffer) {
+			same = same && (buffer.empty() || close_values(buffer[a], buffer[b], epsilon));
+		});
+		return same;
+	};
+
+	std::vector<int> remap(nverts, -1);
+	std::vector<int> kept;
+	// representatives of each cell, chained through nextInCell
+	CellTable cells(nverts);
+	std::vector<int> nextInCell(nverts, -1);
+	float cellSize = 2 * epsilon;
+	for (size_t v = 0; v < nverts; v++) {
+		if (!used[v])
+			continue;
+		const ygl::vec3f &p = shp->pos[v];
+		// cell of the vertex and, on each axis, the side of the neighbour cell
+		// that can hold vertices within epsilon (none with a zero epsilon)
+		int64_t cell[3];
+		int side[3];
+		for (int k = 0; k < 3; k++) {
+			if (epsilon > 0) {
+				// far or invalid positions share the border cells
+				double c = std::floor((double)p[k] / cellSize);
+				c = c == c ? std::min(std::max(c, -1e15), 1e15) : 0;
+				double offset = (double)p[k] - c * cellSize;
+				cell[k] = (int64_t)c;
+				side[k] = offset < epsilon ? -1 : 1;
+			}
+			else {
+				float value = p[k] + 0.0f;
+				uint32_t bits;
+				std::memcpy(&bits, &value, sizeof(bits));
+				cell[k] = bits;
+				side[k] = 0;
+			}
+		}
+		int found = -1;
+		for (int n = 0; n < 8 && found < 0; n++) {
+			int64_t neighbour[3];
+			bool skip = false;
+			for (int k = 0; k < 3; k++) {
+				bool move = (n >> k) & 1;
+				skip = skip || (move && side[k] == 0);
+				neighbour[k] = cell[k] + (move ? side[k] : 0);
+			}
+			if (skip)
+				continue;
+			size_t slot = cells.find(cell_key(neighbour));
+			for (int r = cells.heads[slot]; r >= 0; r = nextInCell[r]) {
+				if (same_vertex(r, (int)v)) {
+					found = r;
+					break;
+				}
+			}
+		}
+		if (found >= 0) {
+			remap[v] = remap[found];
+			continue;
+		}
+		remap[v] = (int)kept.size();
+		kept.push_back((int)v);
+		uint64_t key = cell_key(cell);
+		size_t slot = cells.find(key);
+		cells.keys[slot] = key;
+		nextInCell[v] = cells.heads[slot];
+		cells.heads[slot] = (int)v;
+	}
+
+	if (kept.size() == nverts)
+		return 0;
+	for_each_vertex_buffer(shp, [&kept](auto &buffer) {
+		if (buffer.empty())
+			return;
+		typename std::remove_reference<decltype(buffer)>::type compact(kept.size());
+		for (size_t i = 0; i < kept.size(); i++)
+			compact[i] = buffer[kept[i]];
+		buffer.swap(compact);
+	});
+	for_each_element_index(shp, [&remap](int &v) {
+		v = remap[v];
+	});
+	return (nverts - kept.size()) * vertexBytes;
+}
+
+//
+// vertex_cache_misses
+// Vertices transformed by a FIFO cache of cacheSize entries to draw the
+// triangles, in their order.
+//
+static size_t vertex_cache_misses(const std::vector<ygl::vec3i> &triangles, size_t nverts, int cacheSize) {
+	// misses when the vertex entered the cache
+	std::vector<size_t> entered(nverts, 0);
+	std::vector<char> seen(nverts, 0);
+	size_t misses = 0;
+	for (auto &t : triangles) {
+		for (int k = 0; k < 3; k++) {
+			int v = t[k];
+			if (seen[v] && misses - entered[v] < (size_t)cacheSize)
+				continue;
+			seen[v] = 1;
+			entered[v] = misses++;
+		}
+	}
+	return misses;
+}
+
+//
+// tipsify
+// Returns the new order of the triangles. Starting from a vertex, all its
+// remaining triangles are emitted; the next vertex is the one of their 1-ring
+// that will still be in the cache and has the fewest triangles left, or else
+// the last vertex emitted that still has triangles (dead-end stack) or the
+// next one in the input order.
+//
+static std::vector<int> tipsify(const std::vector<ygl::vec3i> &triangles, size_t nverts, int cacheSize) {
+	size_t ntris = triangles.size();
+	// triangles around each vertex
+	std::vector<int> live(nverts, 0);
+	for (auto &t : triangles)
+		for (int k = 0; k < 3; k++)
+			live[t[k]]++;
+	std::vector<size_t> offset(nverts + 1, 0);
+	for (size_t v = 0; v < nverts; v++)
+		offset[v + 1] = offset[v] + live[v];
+	std::vector<int> adjacency(offset[nverts]);
+	{
+		std::vector<size_t> fill(offset.begin(), offset.end() - 1);
+		for (size_t i = 0; i < ntris; i++)
+			for (int k = 0; k < 3; k++)
+				adjacency[fill[triangles[i][k]]++] = (int)i;
+	}
+
+	std::vector<int> order;
+	order.reserve(ntris);
+	std::vector<char> emitted(ntris, 0);
+	std::vector<int> cacheTime(nverts, 0);
+	std::vector<int> deadEnd;
+	std::vector<int> candidates;
+	int time = cacheSize + 1;
+	size_t cursor = 0;
+	int f = 0;
+	while (f >= 0) {
+		candidates.clear();
+		for (size_t a = offset[f]; a < offset[f + 1]; a++) {
+			int t = adjacency[a];
+			if (emitted[t])
+				continue;
+			emitted[t] = 1;
+			order.push_back(t);
+			for (int k = 0; k < 3; k++) {
+				int v = triangles[t][k];
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+		}
+
+		// next fanning vertex
+		int best = -1;
+		int bestPriority = -1;
+		for (int v : candidates) {
+			if (live[v] <= 0)
+				continue;
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+				priority = time - cacheTime[v];
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				best = v;
+			}
+		}
+		if (best < 0) {
+			while (!deadEnd.empty() && best < 0) {
+				int v = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[v] > 0)
+					best = v;
+			}
+			while (best < 0 && cursor < nverts) {
+				if (live[cursor] > 0)
+					best = (int)cursor;
+				cursor++;
+			}
+		}
+		f = best;
+	}
+	return order;
+}
+
+//
+// optimize_vertex_cache
+//
+VertexCacheStats optimize_vertex_cache(ygl::shape *shp, int cacheSize) {
+	VertexCacheStats stats;
+	auto start = std::chrono::steady_clock::now();
+	size_t nverts = shp->pos.size();
+	if (nverts == 0 || !shp->quads_pos.empty() || !shp->quads_norm.empty() ||
+		!shp->quads_texcoord.empty())
+		return stats;
+	bool consistent = true;
+	for_each_vertex_buffer(shp, [&](auto &buffer) {
+		consistent = consistent && (buffer.empty() || buffer.size() == nverts);
+	});
+	bool valid = true;
+	for_each_element_index(shp, [&](int &v) {
+		valid = valid && v >= 0 && (size_t)v < nverts;
+	});
+	if (!consistent || !valid)
+		return stats;
+
+	if (!shp->triangles.empty()) {
+		stats.triangles = shp->triangles.size();
+		stats.acmrBefore = (float)vertex_cache_misses(shp->triangles, nverts, cacheSize) / stats.triangles;
+		std::vector<int> order = tipsify(shp->triangles, nverts, cacheSize);
+		std::vector<ygl::vec3i> triangles(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+			triangles[i] = shp->triangles[order[i]];
+		shp->triangles.swap(triangles);
+		stats.acmrAfter = (float)vertex_cache_misses(shp->triangles, nverts, cacheSize) / stats.triangles;
+	}
+
+	// vertices in order of first use, the unused ones at the end
+	std::vector<int> remap(nverts, -1);
+	std::vector<int> order;
+	order.reserve(nverts);
+	for_each_element_index(shp, [&](int &v) {
+		if (remap[v] < 0) {
+			remap[v] = (int)order.size();
+			order.push_back(v);
+		}
+	});
+	for (size_t v = 0; v < nverts; v++) {
+		if (remap[v] < 0) {
+			remap[v] = (int)order.size();
+			order.push_back((int)v);
+		}
+	}
+	for_each_vertex_buffer(shp, [&order](auto &buffer) {
+		if (buffer.empty())
+			return;
+		typename std::remove_reference<decltype(buffer)>::type reordered(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+			reordered[i] = buffer[order[i]];
+		buffer.swap(reordered);
+	});
+	for_each_element_index(shp, [&remap](int &v) {
+		v = remap[v];
+	});
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	stats.seconds = elapsed.count();
+	return stats;
+}
@@ -0,0 +1,39 @@
+#ifndef __MESHOPTIMIZER__
+#define __MESHOPTIMIZER__
+#include <cstddef>
+#include "../yocto/yocto_gl.h"
+
+//
+// weld_vertices
+// Merges the vertices of a shape that have the same attributes (position,
+// normal, texture coordinates, color, ...), each one within epsilon of the
+// first vertex of the group, and drops the vertices that no element uses. The
+// elements are remapped to the remaining vertices, which keep their order.
+// Shapes with face-varying quads are left as they are. Returns the number of
+// bytes removed from the vertex buffers.
+//
+size_t weld_vertices(ygl::shape *shp, float epsilon);
+
+//
+// VertexCacheStats
+// Result of optimize_vertex_cache: average cache miss ratio (vertices
+// transformed per triangle, for a FIFO cache) before and after the
+// optimization, and time taken.
+//
+struct VertexCacheStats {
+	size_t triangles = 0;
+	float acmrBefore = 0;
+	float acmrAfter = 0;
+	double seconds = 0;
+};
+
+//
+// optimize_vertex_cache
+// Reorders the triangles of a shape so that they reuse the vertices in a
+// post-transform cache of cacheSize entries (Tipsify, Sander et al. 2007),
+// then renumbers the vertices in the order they are first used by the
+// elements, so they are read sequentially too. Shapes with face-varying quads
+// are left as they are.
+//
+VertexCacheStats optimize_vertex_cache(ygl::shape *shp, int cacheSize = 16);
+#endif
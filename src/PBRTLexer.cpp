@@ -1,23 +1,162 @@
 #include "PBRTLexer.h"
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PBRT_LEXER_SSE2 1
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// ---------------------------------------------------------------------------
+//                          BLANKS SCANNING
+// ---------------------------------------------------------------------------
+
+static inline bool is_blank(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+#if defined(__AVX2__) || defined(PBRT_LEXER_SSE2)
+// index of the lowest set bit (mask must not be 0)
+static inline int lowest_bit(unsigned int mask) {
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward(&idx, mask);
+	return (int)idx;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+//
+// skip_blank_run
+// Returns the position of the first non blank character in text[pos, end), or end
+// if there is none. Blanks are checked 32 (AVX2) or 16 (SSE2) characters at a time.
+//
+static size_t skip_blank_run(const char *text, size_t pos, size_t end) {
+#if defined(__AVX2__)
+	const __m256i spaces = _mm256_set1_epi8(' ');
+	const __m256i tabs = _mm256_set1_epi8('\t');
+	const __m256i crs = _mm256_set1_epi8('\r');
+	const __m256i nls = _mm256_set1_epi8('\n');
+	while (pos + 32 <= end) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i *)(text + pos));
+		__m256i blank = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, spaces), _mm256_cmpeq_epi8(chunk, tabs)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(chunk, crs), _mm256_cmpeq_epi8(chunk, nls)));
+		unsigned int blankMask = (unsigned int)_mm256_movemask_epi8(blank);
+		if (blankMask != 0xFFFFFFFFu)
+			return pos + lowest_bit(~blankMask);
+		pos += 32;
+	}
+#elif defined(PBRT_LEXER_SSE2)
+	const __m128i spaces = _mm_set1_epi8(' ');
+	const __m128i tabs = _mm_set1_epi8('\t');
+	const __m128i crs = _mm_set1_epi8('\r');
+	const __m128i nls = _mm_set1_epi8('\n');
+	while (pos + 16 <= end) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *)(text + pos));
+		__m128i blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, spaces), _mm_cmpeq_epi8(chunk, tabs)),
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, crs), _mm_cmpeq_epi8(chunk, nls)));
+		unsigned int blankMask = (unsigned int)_mm_movemask_epi8(blank);
+		if (blankMask != 0xFFFFu)
+			return pos + lowest_bit(~blankMask & 0xFFFFu);
+		pos += 16;
+	}
+#endif
+	// scalar loop (tail of the text or no SIMD support)
+	for (; pos < end; pos++) {
+		if (!is_blank(text[pos]))
+			return pos;
+	}
+	return end;
+}
 
 //
 // constructor
 //
-PBRTLexer::PBRTLexer(std::string filename) {
-	this->line = 1;
-	this->column = 0;
-	this->text = read_file(filename);
-	this->lastPos = text.length() - 1;
+PBRTLexer::PBRTLexer(std::string filename, const LexemeCache *cache, bool fillCache) {
 	this->currentPos = 0;
-
-	if (text.length() == 0)
-		this->inputEnded = true;
-	else
-		this->inputEnded = false;
+	this->indexedPos = 1;
+	this->text = nullptr;
+	this->textComplete = false;
+	this->length = 0;
+	this->inputEnded = false;
 
 	auto path_and_name = get_path_and_filename(filename);
 	this->path = path_and_name.first;
 	this->filename = path_and_name.second;
+	this->sourceFile = filename;
+
+	if (cache) {
+		this->cacheReader = cache->open(filename);
+		if (this->cacheReader)
+			return;
+	}
+	this->load_text();
+	if (cache && fillCache)
+		this->cacheWriter = cache->create(filename);
+}
+
+//
+// load_text
+//
+void PBRTLexer::load_text() {
+	// compressed files are inflated while they are read
+	this->input.reset(new InputBuffer(this->sourceFile, true));
+	if (!this->input->is_open() && this->input->is_compressed())
+		throw PBRTException("Cannot decompress file '" + this->sourceFile + "'.");
+	if (!this->input->is_open())
+		throw PBRTException("Cannot open file '" + this->sourceFile + "'.");
+	this->text = this->input->data();
+	this->length = 0;
+	this->inputEnded = false;
+	this->extend_text();
+}
+
+//
+// extend_text
+// While a compressed file is being inflated, the lexer only sees the text up
+// to the last newline inflated, which ends it as the final newline does: no
+// lexeme is cut, and the head can go on once more lines are available.
+// Returns false if the text cannot grow anymore.
+//
+bool PBRTLexer::extend_text() {
+	if (this->textComplete)
+		return false;
+	size_t old = this->length;
+	size_t seen = old;
+	while (true) {
+		// the size read after the end of the inflation is final
+		bool complete = this->input->is_complete();
+		size_t available = complete ? this->input->size() : this->input->wait_for(seen + (1 << 20));
+		if (complete) {
+			if (!this->input->is_open())
+				throw PBRTException("Cannot decompress file '" + this->sourceFile + "'.");
+			this->textComplete = true;
+			if (available == 0) {
+				// the file is only made of the virtual newline
+				this->length = 1;
+				this->inputEnded = true;
+				return true;
+			}
+			// the last line is always terminated by a newline (real or virtual)
+			this->length = this->text[available - 1] == '\n' ? available : available + 1;
+			return this->length > old;
+		}
+		for (size_t pos = available; pos > seen; pos--) {
+			if (this->text[pos - 1] == '\n') {
+				this->length = pos;
+				return true;
+			}
+		}
+		seen = available;
+	}
 }
 
 //
@@ -25,145 +164,318 @@ PBRTLexer::PBRTLexer(std::string filename) {
 // get the next lexeme in the file.
 //
 bool PBRTLexer::next_lexeme() {
+	if (this->prelexStop != PrelexStop::None && this->replay_lexeme())
+		return true;
+	this->read_lexeme();
+	return true;
+}
+
+//
+// read_lexeme
+// Lexemes read from the text are saved in the cache, if it is being filled.
+//
+void PBRTLexer::read_lexeme() {
+	if (this->cacheReader) {
+		if (this->cacheReader->next(this->currentLexeme, this->currentPos))
+			return;
+		if (!this->cacheReader->is_corrupted())
+			throw InputEndedException();
+		// go on with the text after the last lexeme of the cache
+		this->corruptedCacheReader = std::move(this->cacheReader);
+		if (!this->text)
+			this->load_text();
+	}
+	this->scan_lexeme();
+	if (this->cacheWriter)
+		this->cacheWriter->append(this->currentLexeme, this->currentPos);
+	if (this->currentLexeme.directive != Directive::Unknown && this->input->is_compressed())
+		this->release_text();
+}
+
+//
+// release_text
+// The text inflated from a compressed file is given back as the parser goes
+// on: when a directive is read, the parser is done with the lexemes before
+// the previous one (the current directive can still use its parameters).
+// Memory is released in big steps, after indexing the newlines for the
+// diagnostics. Pre-lexed lexemes are views on the text: nothing is released
+// until they have been replayed.
+//
+void PBRTLexer::release_text() {
+	size_t start = this->currentLexeme.value.data() - this->text;
+	size_t previous = this->lastDirectivePos;
+	this->lastDirectivePos = start;
+	if (this->prelexStop != PrelexStop::None || previous < this->releasedPos + (8 << 20))
+		return;
+	this->index_newlines();
+	this->input->release(previous);
+	this->releasedPos = previous;
+	// the head never goes back in the released text: its newlines are counted
+	auto released = std::lower_bound(this->newlines.begin(), this->newlines.end(), previous);
+	if (released != this->newlines.begin()) {
+		this->releasedNewlines += released - this->newlines.begin();
+		this->lastReleasedNewline = *(released - 1);
+		this->newlines.erase(this->newlines.begin(), released);
+	}
+}
+
+//
+// scan_lexeme
+// read the next lexeme from the text.
+//
+void PBRTLexer::scan_lexeme() {
 	this->remove_blanks();
 
 	if (this->read_indentifier())
-		return true;
+		return;
 	if (this->read_string())
-		return true;
+		return;
 	if (this->read_number())
-		return true;
+		return;
 
 	char c = this->peek();
 	if (c == '[' || c == ']') {
-		std::stringstream ss = std::stringstream();
-		ss.put(c);
-		this->currentLexeme = Lexeme(LexemeType::SINGLETON, ss.str());
+		this->currentLexeme = Lexeme(LexemeType::SINGLETON, this->view_from(this->currentPos, 1));
 		this->advance();
-		return true;
+		return;
 	}
 
 	throw_lexical_exception("input symbol not recognized.");
 }
 
 
+//
+// prelex
+// Reads ahead the lexemes of the text, stopping at its end, at the first lexical
+// error or when the memory held reaches maxBytes: the lexemes with their end
+// positions and, for compressed files, the text inflated so far (it cannot be
+// released before it is replayed). The head is then moved back to the start of
+// the text, so that next_lexeme() gives again the same lexemes, and the same
+// positions for the diagnostics, as if they were read now.
+//
+void PBRTLexer::prelex(size_t maxBytes) {
+	const size_t lexemeBytes = sizeof(Lexeme) + sizeof(size_t);
+	bool holdsText = !this->cacheReader && this->input && this->input->is_compressed();
+	size_t maxLexemes = maxBytes / lexemeBytes;
+	this->prelexStop = PrelexStop::Limit;
+	this->prelexed.reserve(std::min(maxLexemes, this->length / 2 + 1));
+	this->prelexedEnds.reserve(std::min(maxLexemes, this->length / 2 + 1));
+	try {
+		while (this->prelexed.size() * lexemeBytes + (holdsText ? this->currentPos : 0) < maxBytes) {
+			this->read_lexeme();
+			this->prelexed.push_back(this->currentLexeme);
+			this->prelexedEnds.push_back(this->currentPos);
+		}
+	}
+	catch (const InputEndedException &) {
+		this->prelexStop = PrelexStop::Ended;
+	}
+	catch (const PBRTException &ex) {
+		this->prelexStop = PrelexStop::Error;
+		this->prelexError = ex.what();
+		this->prelexErrorPos = this->currentPos;
+	}
+	// the state of the head after the last lexeme is kept for the case the
+	// limit is reached: inputEnded is not used while replaying.
+	this->currentPos = 0;
+	this->currentLexeme = Lexeme();
+}
+
+//
+// complete_cache
+// Errors in the rest of the text only mean that the cache is not saved.
+//
+void PBRTLexer::complete_cache() {
+	if (!this->cacheWriter)
+		return;
+	try {
+		while (true)
+			this->read_lexeme();
+	}
+	catch (const InputEndedException &) {
+	}
+	catch (const PBRTException &) {
+	}
+}
+
+//
+// replay_lexeme
+// Gives the next pre-lexed lexeme. Returns false when they are finished and the
+// lexer must go on reading the text.
+//
+bool PBRTLexer::replay_lexeme() {
+	if (this->replayed < this->prelexed.size()) {
+		this->currentLexeme = this->prelexed[this->replayed];
+		this->currentPos = this->prelexedEnds[this->replayed];
+		this->replayed++;
+		return true;
+	}
+	if (this->prelexStop == PrelexStop::Ended)
+		throw InputEndedException();
+	if (this->prelexStop == PrelexStop::Error) {
+		this->currentPos = this->prelexErrorPos;
+		throw PBRTException(this->prelexError);
+	}
+	// limit reached: the head is already after the last lexeme, free the
+	// replay buffers and continue from the text.
+	this->prelexStop = PrelexStop::None;
+	std::vector<Lexeme>().swap(this->prelexed);
+	std::vector<size_t>().swap(this->prelexedEnds);
+	return false;
+}
+
+
 bool PBRTLexer::read_indentifier() {
 	char c = this->peek();
 
-	std::stringstream ss;
 	if (!std::isalpha(c))
 		return false;
-	do {
-		ss << c;
-		this->advance();
-	} while (std::isalpha(c = this->peek()));
+	// identifiers always end before the final newline
+	size_t start = this->currentPos;
+	size_t last = this->length - 1;
+	size_t pos = start + 1;
+	while (pos < last && std::isalpha(this->text[pos]))
+		pos++;
+	this->currentPos = pos;
 
-	this->currentLexeme = Lexeme(LexemeType::IDENTIFIER, ss.str());
+	this->currentLexeme = Lexeme(LexemeType::IDENTIFIER, this->view_from(start, this->currentPos - start));
+	this->currentLexeme.directive = lookup_directive(this->currentLexeme.value);
 	return true;
 }
 
 
 bool PBRTLexer::read_string() {
 	char c = this->peek();
-	std::stringstream ss;
 	// remove "
 	if (!(c == '"'))
 		return false;
 	this->advance();
-	while ((c = this->peek()) != '"') {
-		ss << c;
-		this->advance();
+	size_t start = this->currentPos;
+	size_t last = this->length - 1;
+	const char *quote = start < last ? (const char *)memchr(this->text + start, '"', last - start) : nullptr;
+	// the string might go on in the lines still being inflated
+	while (!quote && this->extend_text()) {
+		last = this->length - 1;
+		quote = start < last ? (const char *)memchr(this->text + start, '"', last - start) : nullptr;
 	}
+	if (!quote) {
+		// the string is not terminated: consume the input till its end.
+		while (true)
+			this->advance();
+	}
+	size_t end = quote - this->text;
+	this->currentPos = end;
 	this->advance();
-	this->currentLexeme = Lexeme(LexemeType::STRING, ss.str());
+	this->currentLexeme = Lexeme(LexemeType::STRING, this->view_from(start, end - start));
 	return true;
 }
 
+//
+// read_number
+// Validates and converts the number in a single pass. The accepted syntax is
+// [+|-] digits [. [digits]] [(e|E) [+|-] digits], where the integer part can be
+// omitted if the fractional one is present. On error the head is left on the
+// offending character, so that the message reports its position.
+//
 bool PBRTLexer::read_number() {
 	char c = this->peek();
 	if (!(c == '+' || c == '-' || c == '.' || std::isdigit(c)))
 		return false;
-	std::stringstream ss;
-	bool point_seen = false;
-	/*
-	* state = 0: a digit, `+`, `-` or `.` expected
-	* state = 7: `+` or `-` seen, waiting for one digit or dot (7 because otherwise I had to rename all the others)
-	* state = 1: waiting for one mandatory digit
-	* state = 2: waiting for more digits or `.` (if not seen before) [final state]
-	* state = 3: waiting for zero or ore digits after point [final state]
-	* state = 4: waiting for `-`, `+` or a digit after "E" (exponential)
-	* state = 5: waiting for mandatory digit
-	* state = 6: waiting for zero or more additional digits [final state]
-	*/
-	int state = 0;
+	size_t start = this->currentPos;
+	// from_chars does not accept an explicit plus, and accepts "inf" and
+	// "nan" after a minus: check what follows the sign here.
+	size_t first = start;
+	if (c == '+' || c == '-') {
+		char next = this->peek(1);
+		if (!(next == '.' || std::isdigit(next)))
+			this->throw_number_exception(start + 1);
+		if (c == '+')
+			first++;
+	}
 
-	while (true) {
-		if (state == 0 && (c == '-' || c == '+' || c == '.')) {
-			if (c == '.') {
-				point_seen = true;
-				state = 1; // at least one digit needed
-			}
-			else {
-				state = 7;
-			}
-		}
-		else if (state == 0 && std::isdigit(c)) {
-			state = 2;
-		}
-		else if (state == 1 && std::isdigit(c)) {
-			if (point_seen)
-				state = 3;
-			else
-				state = 2;
-		}
-		else if (state == 2 && c == '.' && !point_seen) {
-			point_seen = true;
-			state = 3;
-		}
-		else if (state == 2 && std::isdigit(c)) {
-			state = 2;
-		}
-		else if (state == 2 && (std::tolower(c) == 'e')) {
-			state = 4;
-		}
-		else if (state == 3 && std::isdigit(c)) {
-			state = 3;
-		}
-		else if (state == 3 && (std::tolower(c) == 'e')) {
-			state = 4;
-		}
-		else if (state == 4 && (c == '-' || c == '+')) {
-			state = 5;
-		}
-		else if (state == 4 && std::isdigit(c)) {
-			state = 6;
-		}
-		else if (state == 5 && std::isdigit(c)) {
-			state = 6;
-		}
-		else if (state == 6 && std::isdigit(c)) {
-			state = 6;
+	const char *end = this->text + this->input->size();
+	double value = 0;
+	auto res = std::from_chars(this->text + first, end, value);
+	if (res.ec == std::errc::invalid_argument) {
+		// no digits before or after the point
+		size_t errPos = start + 1;
+		if ((c == '+' || c == '-') && this->peek(1) == '.')
+			errPos++;
+		this->throw_number_exception(errPos);
+	}
+	size_t last = res.ptr - this->text;
+	if (last < this->input->size() && (*res.ptr == 'e' || *res.ptr == 'E')) {
+		// exponent without digits
+		char next = this->peek(last - start + 1);
+		this->throw_number_exception(next == '+' || next == '-' ? last + 2 : last + 1);
+	}
+	if (res.ec == std::errc::result_out_of_range) {
+		// let strtod pick the right infinity or zero
+		value = std::strtod(std::string(this->text + first, last - first).c_str(), nullptr);
+	}
+
+	this->currentPos = last;
+	this->currentLexeme = Lexeme(LexemeType::NUMBER, this->view_from(start, last - start));
+	this->currentLexeme.number = value;
+	return true;
+}
+
+//
+// throw_number_exception
+// Move the head on the character that makes the number not valid and throw.
+//
+void PBRTLexer::throw_number_exception(size_t errPos) {
+	this->currentPos = errPos;
+	throw_lexical_exception("wrong litteral specification.");
+}
+
+//
+// count_array_values
+// Cheap scan of the text that follows the head, counting the values met before
+// the closing ']'. It does not validate anything: it is only used to size the
+// buffers before an array is actually parsed (while a compressed file is being
+// inflated, values not inflated yet are not counted).
+//
+size_t PBRTLexer::count_array_values() {
+	if (this->cacheReader) {
+		// lexemes pre-lexed from the cache come first
+		size_t count = 0;
+		for (size_t i = this->replayed; i < this->prelexed.size(); i++) {
+			if (this->prelexed[i].type == LexemeType::SINGLETON)
+				return count;
+			count++;
 		}
-		else if (state == 7 && std::isdigit(c)) {
-			state = 2;
+		return count + this->cacheReader->count_array_values();
+	}
+	auto is_blank = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+	size_t count = 0;
+	size_t pos = this->currentPos;
+	size_t end = this->length - 1;
+	while (pos < end) {
+		char c = this->text[pos];
+		if (c == ']' || c == '[')
+			break;
+		if (is_blank(c)) {
+			pos++;
 		}
-		else if (state == 7 && c == '.') {
-			point_seen = true;
-			state = 1;
+		else if (c == '#') {
+			while (pos < end && this->text[pos] != '\n')
+				pos++;
 		}
-		else if (state == 2 || state == 3 || state == 6) {
-			// legal point of exit
-			break;
+		else if (c == '"') {
+			count++;
+			pos++;
+			while (pos < end && this->text[pos] != '"')
+				pos++;
+			pos++;
 		}
 		else {
-			throw_lexical_exception("wrong litteral specification.");
+			count++;
+			while (pos < end && !is_blank(c = this->text[pos]) && c != '[' && c != ']' && c != '"' && c != '#')
+				pos++;
 		}
-		ss << c;
-		this->advance();
-		c = this->peek();
 	}
-	this->currentLexeme = Lexeme(LexemeType::NUMBER, ss.str());
-	return true;
+	return count;
 }
 
 //
@@ -171,23 +483,22 @@ bool PBRTLexer::read_number() {
 // Moves the lexer to the next character in the string.
 //
 void PBRTLexer::advance() {
-	if (this->currentPos < this->lastPos) {
+	if (this->currentPos + 1 < this->length || this->extend_text()) {
 		this->currentPos++;
-		this->column++;
-		char tmp = this->peek();
-		if (tmp == '\n') {
-			this->line++;
-			this->column = 0;
-		}
 	}
-	else if (this->inputEnded)
+	else if (this->inputEnded) {
+		// the whole text has been read: the cache is complete
+		if (this->cacheWriter) {
+			this->cacheWriter->commit();
+			this->cacheWriter.reset();
+		}
 		throw InputEndedException();
+	}
 	else {
-		// a trick to avoid to lose the last lexeme
+		// a trick to avoid to lose the last lexeme: move the head on the
+		// blanks that follow the text.
 		this->inputEnded = true;
-		this->currentPos = 0;
-		this->text = "  ";
-		this->lastPos = 1;
+		this->currentPos = this->length;
 	}
 }
 
@@ -198,19 +509,25 @@ void PBRTLexer::advance() {
 // that are not part of the alphabet.
 //
 void PBRTLexer::remove_blanks() {
+	// the last character (length - 1) is always a newline, real or virtual:
+	// the fast paths work before it, the end of the input is left to advance().
 	while (true) {
+		size_t end = this->length - 1;
 		char tmp = this->peek();
-		if (tmp == ' ' || tmp == '\t' || tmp == '\r' || tmp == '\n') {
-			this->advance();
+		if (is_blank(tmp)) {
+			if (this->currentPos + 1 >= end) {
+				this->advance();
+				continue;
+			}
+			// skip the whole run of blanks
+			size_t next = skip_blank_run(this->text, this->currentPos + 1, end);
+			this->currentPos = next < end ? next : end - 1;
 			continue;
 		}
 		else if (tmp == '#') {
-			// comment
-			while (tmp != '\n') {
-				this->advance();
-				tmp = this->peek();
-			}
-			this->advance();
+			// comment: jump on the newline that ends it
+			const char *nl = (const char *)memchr(this->text + this->currentPos, '\n', end - this->currentPos);
+			this->currentPos = nl ? nl - this->text : end;
 			continue;
 		}
 		else {
@@ -219,3 +536,83 @@ void PBRTLexer::remove_blanks() {
 		}
 	}
 }
+
+//
+// index_newlines
+// Extends the index of the newlines up to the current position (included).
+//
+void PBRTLexer::index_newlines() {
+	if (!this->text)
+		this->load_text();
+	// the head is moved past the end of the text only when the input has ended
+	size_t pos = this->currentPos < this->length ? this->currentPos : this->length - 1;
+	if (pos < this->indexedPos)
+		return;
+	size_t last = this->length - 1;
+	size_t end = pos + 1 < last ? pos + 1 : last;
+	while (this->indexedPos < end) {
+		const char *nl = (const char *)memchr(this->text + this->indexedPos, '\n', end - this->indexedPos);
+		if (!nl)
+			break;
+		this->newlines.push_back(nl - this->text);
+		this->indexedPos = nl - this->text + 1;
+	}
+	this->indexedPos = end;
+	// the final newline might be virtual: it is not in the text
+	if (pos == last) {
+		this->newlines.push_back(last);
+		this->indexedPos = last + 1;
+	}
+}
+
+//
+// find_line_column
+//
+bool PBRTLexer::find_line_column(const std::string &filename, size_t pos, int &line, int &column) {
+	InputBuffer input(filename);
+	if (!input.is_open())
+		return false;
+	// the head can be on the final newline (virtual, if the file does not end
+	// with one), or past it
+	bool virtualNewline = input.size() == 0 || input.data()[input.size() - 1] != '\n';
+	pos = std::min(pos, virtualNewline ? input.size() : input.size() - 1);
+	size_t end = std::min(pos + 1, input.size());
+	line = 1;
+	size_t lastNewline = 0;
+	bool newlineMet = false;
+	for (const char *p = input.data(), *stop = input.data() + end; (p = (const char *)memchr(p, '\n', stop - p)); p++) {
+		line++;
+		lastNewline = p - input.data();
+		newlineMet = true;
+	}
+	if (virtualNewline && pos == input.size()) {
+		line++;
+		lastNewline = pos;
+		newlineMet = true;
+	}
+	column = (int)(newlineMet ? pos - lastNewline : pos);
+	return true;
+}
+
+//
+// get_line
+// Line of the head: 1 + number of newlines in (0, currentPos].
+//
+int PBRTLexer::get_line() {
+	this->index_newlines();
+	size_t pos = this->currentPos < this->length ? this->currentPos : this->length - 1;
+	return 1 + (int)(this->releasedNewlines + (std::upper_bound(this->newlines.begin(), this->newlines.end(), pos) - this->newlines.begin()));
+}
+
+//
+// get_column
+// Distance of the head from the last newline met.
+//
+int PBRTLexer::get_column() {
+	this->index_newlines();
+	size_t pos = this->currentPos < this->length ? this->currentPos : this->length - 1;
+	auto it = std::upper_bound(this->newlines.begin(), this->newlines.end(), pos);
+	if (it == this->newlines.begin())
+		return (int)(this->releasedNewlines ? pos - this->lastReleasedNewline : pos);
+	return (int)(pos - *(it - 1));
+}
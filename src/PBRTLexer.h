@@ -1,10 +1,14 @@
 #ifndef __PBRTLEXER__
 #define __PBRTLEXER__
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <fstream>
 #include <exception>
+#include <memory>
+#include <vector>
 #include "utils.h"
+#include "LexemeCache.h"
 
 class InputEndedException : public std::exception {
 
@@ -32,30 +36,146 @@ class PBRTException : public std::exception {
 
 enum LexemeType { IDENTIFIER, NUMBER, STRING, SINGLETON };
 
+//
+// Directive
+// Directives known by the parser. The lexer interns identifiers into this enum,
+// so that the parser can dispatch them without comparing strings.
+//
+enum class Directive : unsigned char {
+	Unknown, Include, Camera, Film, Translate, Transform, ConcatTransform, Scale, Rotate,
+	LookAt, AttributeBegin, AttributeEnd, TransformBegin, TransformEnd, Shape, ObjectBegin,
+	ObjectEnd, ObjectInstance, LightSource, AreaLightSource, Material, MakeNamedMaterial,
+	NamedMaterial, Texture, WorldBegin, WorldEnd, Count
+};
+
+// names of the directives, indexed by Directive
+constexpr std::string_view directiveNames[(int)Directive::Count] = {
+	"", "Include", "Camera", "Film", "Translate", "Transform", "ConcatTransform", "Scale", "Rotate",
+	"LookAt", "AttributeBegin", "AttributeEnd", "TransformBegin", "TransformEnd", "Shape", "ObjectBegin",
+	"ObjectEnd", "ObjectInstance", "LightSource", "AreaLightSource", "Material", "MakeNamedMaterial",
+	"NamedMaterial", "Texture", "WorldBegin", "WorldEnd"
+};
+
+//
+// KeywordTable
+// Perfect hash table from a fixed set of names to the values of the enum E, whose
+// first value (the "unknown" one) has an empty name. The hash is a multiplicative
+// hash of the first two characters, the last one and the length, with a seed
+// chosen for the set of names so that they fall in distinct slots among 2^Bits.
+// Slot 0 is reserved to names that are not in the table: the table is built at
+// compile time, and "perfect" tells whether the seed is good.
+//
+template <typename E, size_t N, unsigned int Seed, unsigned int Bits>
+struct KeywordTable {
+	const std::string_view *names;
+	E slots[1 << Bits] = {};
+	bool perfect = true;
+
+	static constexpr unsigned int hash(std::string_view s) {
+		if (s.empty())
+			return 0;
+		unsigned int key = (unsigned int)(unsigned char)s[0] |
+			(unsigned int)(unsigned char)s[s.size() > 1 ? 1 : 0] << 8 |
+			(unsigned int)(unsigned char)s[s.size() - 1] << 16 | (unsigned int)s.size() << 24;
+		return (key * Seed) >> (32 - Bits);
+	}
+
+	constexpr KeywordTable(const std::string_view (&names)[N]) : names(names) {
+		for (size_t i = 1; i < N; i++) {
+			unsigned int h = hash(names[i]);
+			if (h == 0 || slots[h] != E{})
+				perfect = false;
+			slots[h] = (E)i;
+		}
+	}
+
+	// returns the unknown value if s is not in the table.
+	E lookup(std::string_view s) const {
+		E v = slots[hash(s)];
+		return names[(int)v] == s ? v : E{};
+	}
+};
+
+constexpr KeywordTable<Directive, (size_t)Directive::Count, 29543, 6> directiveTable(directiveNames);
+static_assert(directiveTable.perfect, "Directive names collide in the hash table, change the seed.");
+
+//
+// lookup_directive
+// Returns Directive::Unknown if the identifier is not a known directive.
+//
+inline Directive lookup_directive(std::string_view s) {
+	return directiveTable.lookup(s);
+}
+
+//
+// Lexeme
+// A lexeme does not own its text: value is a view on the lexer's buffer, which
+// stays valid as long as the lexer that produced the lexeme is alive.
+// String lexemes do not include the quotes, number lexemes carry the value
+// already converted by the lexer and identifiers the directive they name.
+//
 class Lexeme {
 public:
-	std::string value;
+	std::string_view value;
+	double number = 0;
 	LexemeType type;
+	// interned identifier (Directive::Unknown for the other lexemes)
+	Directive directive = Directive::Unknown;
 	Lexeme() {};
-	Lexeme(LexemeType type, std::string value) {
+	Lexeme(LexemeType type, std::string_view value) {
 		this->type = type;
 		this->value = value;
 	}
+	// materialize the text of the lexeme when an owned string is needed
+	std::string str() const {
+		return std::string(value);
+	}
 };
 
 class PBRTLexer {
 
 private:
-	// current line and column number in the file
-	int line, column;
 	// current position of the Lexer's head
-	int currentPos;
-	// text to be parsed
-	std::string text;
-	// index of last character of the text to be parsed
-	int lastPos;
+	size_t currentPos;
+	// positions of the newlines met so far. Line and column numbers are needed only
+	// by diagnostics, so they are computed on demand from this index, which is
+	// filled lazily up to indexedPos (excluded).
+	std::vector<size_t> newlines;
+	size_t indexedPos;
+	// source file (mapped in memory when possible)
+	std::unique_ptr<InputBuffer> input;
+	// text to be parsed (points inside input, it is not null terminated)
+	const char *text;
+	// number of characters to be parsed. If the file does not end with a
+	// newline, one virtual '\n' is appended at position length - 1.
+	size_t length;
+	// false while the text is still being inflated (see extend_text)
+	bool textComplete;
 	// signals if the input has ended (auxiliary variable.)
 	bool inputEnded;
+
+	// Lexemes read ahead by prelex(), with the position of the head after each
+	// one. next_lexeme() replays them before going on with the text.
+	enum class PrelexStop { None, Limit, Ended, Error };
+	std::vector<Lexeme> prelexed;
+	std::vector<size_t> prelexedEnds;
+	size_t replayed = 0;
+	// why pre-lexing stopped: the input has ended, a lexical error was met (it is
+	// thrown again when the replay reaches it) or the limit was reached (the
+	// lexer continues from the text).
+	PrelexStop prelexStop = PrelexStop::None;
+	std::string prelexError;
+	size_t prelexErrorPos = 0;
+
+	// lexemes of the file replayed from the cache: the text is loaded only if a
+	// diagnostic needs the line and column of the head.
+	std::unique_ptr<LexemeCacheReader> cacheReader;
+	// reader of a corrupted cache: the lexemes it gave still refer to it
+	std::unique_ptr<LexemeCacheReader> corruptedCacheReader;
+	// where the lexemes read from the text are saved for the next runs
+	std::unique_ptr<LexemeCacheWriter> cacheWriter;
+	// file to load if the text is needed
+	std::string sourceFile;
 	
 	// Private methods
 
@@ -64,21 +184,50 @@ private:
 	// advance the lexer head (currentPos)
 	void advance();
 
-	// see the current character
-	inline char peek(int i = 0) {
-		return this->text[currentPos + i];
+	// see the current character. Past the end of the text there are only blanks.
+	inline char peek(size_t i = 0) {
+		size_t pos = currentPos + i;
+		if (pos < length - 1)
+			return this->text[pos];
+		return pos == length - 1 ? '\n' : ' ';
 	}
 
+	// view on count characters of the text, starting at start
+	inline std::string_view view_from(size_t start, size_t count) {
+		return std::string_view(this->text + start, count);
+	}
+
+	// read the next lexeme from the text (or from the cache)
+	void read_lexeme();
+	void scan_lexeme();
+	// map the text of the file
+	void load_text();
+	// wait for more text of a compressed file
+	bool extend_text();
+	// release the text of a compressed file already parsed
+	void release_text();
+	// start of the last directive read and end of the text released
+	size_t lastDirectivePos = 0;
+	size_t releasedPos = 0;
+	// newlines of the released text, which are not in the index anymore
+	size_t releasedNewlines = 0;
+	size_t lastReleasedNewline = 0;
+	// give the next pre-lexed lexeme, false if there are no more
+	bool replay_lexeme();
+
 	// the following functions implements reg exp parsers 
 	// to get meaningful elements in the text (i.e. grammar's terminal symbols).
 	bool read_indentifier();
 	bool read_number();
 	bool read_string();
+	void throw_number_exception(size_t errPos);
+	// make sure the newline index covers the current position
+	void index_newlines();
 
 	// Error handling
 	inline void throw_lexical_exception(std::string msg){
         std::stringstream ss;
-        ss << "Syntax Error (" << this->path + "/" << this->filename << ":" << line << "," << column << "): " << msg;
+        ss << "Syntax Error (" << this->path + "/" << this->filename << ":" << get_line() << "," << get_column() << "): " << msg;
         throw  PBRTException(ss.str());
     };
 
@@ -86,9 +235,25 @@ public:
 	std::string filename;
 	std::string path;
 	Lexeme currentLexeme;
-	PBRTLexer(std::string text);
+	// with a cache, the lexemes are replayed from it when it is up to date.
+	// Otherwise, if fillCache is set, the lexemes read are saved in the cache.
+	PBRTLexer(std::string filename, const LexemeCache *cache = nullptr, bool fillCache = true);
 	bool next_lexeme();
-	int get_column() { return this->column; };
-	int get_line() { return this->line; };
+	// read ahead lexemes taking up to about maxBytes of memory (see the members
+	// above). It must be called before next_lexeme().
+	void prelex(size_t maxBytes);
+	const std::vector<Lexeme> &prelexed_lexemes() const { return this->prelexed; };
+	// read the rest of the text if the cache is being filled, so that it can be
+	// saved even if the parser stops before the end of the file.
+	void complete_cache();
+	size_t count_array_values();
+	int get_column();
+	int get_line();
+	// position of the head in the text
+	size_t get_position() const { return this->currentPos; }
+	// line and column of a position of a file, as get_line and get_column
+	// give them: used by diagnostics given after the lexer is gone. The file is
+	// read again, false if it cannot be.
+	static bool find_line_column(const std::string &filename, size_t pos, int &line, int &column);
 };
 #endif
\ No newline at end of file
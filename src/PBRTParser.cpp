@@ -1,12 +1,24 @@
 #include "PBRTParser.h"
 
 // Build a parser for the scene pointed by "filename"
-PBRTParser::PBRTParser(std::string filename) {
-	this->lexers.push_back(std::shared_ptr<PBRTLexer>(new PBRTLexer(filename)));
+PBRTParser::PBRTParser(std::string filename, std::string cacheDirectory) {
+	if (!cacheDirectory.empty()) {
+		this->lexemeCache.reset(new LexemeCache(cacheDirectory));
+		this->prefetcher.set_cache(this->lexemeCache.get());
+	}
+	this->lexers.push_back(std::shared_ptr<PBRTLexer>(new PBRTLexer(filename, this->lexemeCache.get())));
 	this->scn = new ygl::scene();
 	this->fill_parameter_to_type_mapping();
+	this->prefetcher.scan(filename);
 };
 
+PBRTParser::~PBRTParser() {
+	// the workers must be stopped before the prefetcher and the loader are destroyed
+	this->prefetcher.cancel();
+	this->shapeLoader.cancel();
+	this->pool.shutdown();
+}
+
 
 //
 // parse
@@ -15,6 +27,10 @@ ygl::scene *PBRTParser::parse() {
 	this->advance();
 	this->execute_preworld_directives();
 	this->execute_world_directives();
+	// the files still open are not read after WorldEnd
+	for (auto &lexer : this->lexers)
+		lexer->complete_cache();
+	this->build_shapes();
 	return scn;
 }
 
@@ -26,15 +42,15 @@ ygl::scene *PBRTParser::parse() {
 // check_synonym
 // some types are synonyms, transform them to default.
 //
-std::string PBRTParser::check_synonyms(std::string s) {
+std::string_view PBRTParser::check_synonyms(std::string_view s) {
 	if (s == "point")
-		return std::string("point3");
+		return "point3";
 	if (s == "normal")
-		return std::string("normal3");
+		return "normal3";
 	if (s == "vector")
-		return std::string("vector3");
+		return "vector3";
 	if (s == "color")
-		return std::string("rgb");
+		return "rgb";
 
 	return s;
 }
@@ -42,56 +58,58 @@ std::string PBRTParser::check_synonyms(std::string s) {
 //
 // fill_parameter_to_type_mapping
 //
-#define MP std::make_pair<std::string, std::vector<std::string>>
-
 void PBRTParser::fill_parameter_to_type_mapping() {
+	typedef ParamID P;
+	typedef ParamType T;
+	auto legal = [this](ParamID id, std::vector<ParamType> types) {
+		this->parameterToType[(int)id] = types;
+	};
 	// camera parameters
-	parameterToType.insert(MP("frameaspectratio", { "float" }));
-	parameterToType.insert(MP("lensradius", { "float" }));
-	parameterToType.insert(MP("focaldistance", { "float" }));
-	parameterToType.insert(MP("fov", { "float" }));
+	legal(P::frameaspectratio, { T::Float });
+	legal(P::lensradius, { T::Float });
+	legal(P::focaldistance, { T::Float });
+	legal(P::fov, { T::Float });
 	// film
-	parameterToType.insert(MP("xresolution", { "integer" }));
-	parameterToType.insert(MP("yresolution", { "integer" }));
-	parameterToType.insert(MP("lensradius", { "float" }));
+	legal(P::xresolution, { T::Integer });
+	legal(P::yresolution, { T::Integer });
 	// curve
-	parameterToType.insert(MP("p", { "point3" }));
-	parameterToType.insert(MP("type", { "string" }));
-	parameterToType.insert(MP("N", { "normal3" }));
-	parameterToType.insert(MP("splitdepth", { "integer" }));
-	parameterToType.insert(MP("width", { "float" }));
+	legal(P::p, { T::Point3 });
+	legal(P::type, { T::String });
+	legal(P::N, { T::Normal3 });
+	legal(P::splitdepth, { T::Integer });
+	legal(P::width, { T::Float });
 	// triangle mesh
-	parameterToType.insert(MP("indices", { "integer" }));
-	parameterToType.insert(MP("P", { "point3" }));
-	parameterToType.insert(MP("uv", { "float" }));
+	legal(P::indices, { T::Integer });
+	legal(P::P, { T::Point3 });
+	legal(P::uv, { T::Float });
 	// lights
-	parameterToType.insert(MP("scale", { "spectrum", "rgb", "float" }));
-	parameterToType.insert(MP("L", { "spectrum", "rgb", "blackbody" }));
-	parameterToType.insert(MP("mapname", { "string" }));
-	parameterToType.insert(MP("I", { "spectrum" }));
-	parameterToType.insert(MP("from", { "point3" }));
-	parameterToType.insert(MP("twosided", { "bool" }));
+	legal(P::scale, { T::Spectrum, T::RGB, T::Float });
+	legal(P::L, { T::Spectrum, T::RGB, T::Blackbody });
+	legal(P::mapname, { T::String });
+	legal(P::I, { T::Spectrum });
+	legal(P::from, { T::Point3 });
+	legal(P::twosided, { T::Bool });
 	// materials
-	parameterToType.insert(MP("Kd", { "spectrum", "rgb", "texture" }));
-	parameterToType.insert(MP("Ks", { "spectrum", "rgb", "texture" }));
-	parameterToType.insert(MP("Kr", { "spectrum", "rgb", "texture" }));
-	parameterToType.insert(MP("reflect", { "spectrum", "rgb", "texture" }));
-	parameterToType.insert(MP("Kt", { "spectrum", "rgb", "texture" }));
-	parameterToType.insert(MP("transmit", { "spectrum", "rgb", "texture" }));
-	parameterToType.insert(MP("roughness", { "float", "texture" }));
-	parameterToType.insert(MP("eta", { "spectrum", "rgb", "texture" }));
-	parameterToType.insert(MP("index", { "float" }));
-	parameterToType.insert(MP("amount", { "float", "rgb" }));
-	parameterToType.insert(MP("namedmaterial1", { "string" }));
-	parameterToType.insert(MP("namedmaterial2", { "string" }));
-	parameterToType.insert(MP("bumpmap", { "texture" }));
+	legal(P::Kd, { T::Spectrum, T::RGB, T::Texture });
+	legal(P::Ks, { T::Spectrum, T::RGB, T::Texture });
+	legal(P::Kr, { T::Spectrum, T::RGB, T::Texture });
+	legal(P::reflect, { T::Spectrum, T::RGB, T::Texture });
+	legal(P::Kt, { T::Spectrum, T::RGB, T::Texture });
+	legal(P::transmit, { T::Spectrum, T::RGB, T::Texture });
+	legal(P::roughness, { T::Float, T::Texture });
+	legal(P::eta, { T::Spectrum, T::RGB, T::Texture });
+	legal(P::index, { T::Float });
+	legal(P::amount, { T::Float, T::RGB });
+	legal(P::namedmaterial1, { T::String });
+	legal(P::namedmaterial2, { T::String });
+	legal(P::bumpmap, { T::Texture });
 	// textures
-	parameterToType.insert(MP("filename", { "string" }));
-	parameterToType.insert(MP("value", { "float", "spectrum", "rgb" }));
-	parameterToType.insert(MP("uscale", { "float" }));
-	parameterToType.insert(MP("vscale", { "float" }));
-	parameterToType.insert(MP("tex1", { "texture", "float", "spectrum", "rgb" }));
-	parameterToType.insert(MP("tex2", { "texture", "float", "spectrum", "rgb" }));
+	legal(P::filename, { T::String });
+	legal(P::value, { T::Float, T::Spectrum, T::RGB });
+	legal(P::uscale, { T::Float });
+	legal(P::vscale, { T::Float });
+	legal(P::tex1, { T::Texture, T::Float, T::Spectrum, T::RGB });
+	legal(P::tex2, { T::Texture, T::Float, T::Spectrum, T::RGB });
 }
 
 //
@@ -99,20 +117,19 @@ void PBRTParser::fill_parameter_to_type_mapping() {
 // returns true if the check goes well, false if the parameter is unknown,
 // throws an exception if the type differs from the expected one.
 //
-bool PBRTParser::check_param_type(std::string par, std::string parsedType) {
-	auto p = parameterToType.find(par);
-	if (p == parameterToType.end()) {
+bool PBRTParser::check_param_type(ParamID par, ParamType parsedType) {
+	auto &v = parameterToType[(int)par];
+	if (v.empty()) {
 		return false;
 	}
-	auto v = p->second;
 	if (std::find(v.begin(), v.end(), parsedType) == v.end()) {
 		// build expected type string
 		std::stringstream exp;
 		for (auto x : v)
-			exp << x << "/";
+			exp << paramTypeNames[(int)x] << "/";
 		std::string expstr = exp.str();
 		expstr = expstr.substr(0, expstr.length() - 1);
-		throw_syntax_exception("Parameter '" + par + "' expects a " + expstr + " type. ");
+		throw_syntax_exception("Parameter '" + std::string(paramNames[(int)par]) + "' expects a " + expstr + " type. ");
 	}
 	return true;
 }
@@ -126,6 +143,8 @@ void PBRTParser::advance() {
 		this->lexers.at(0)->next_lexeme();
 	}
 	catch (InputEndedException ex) {
+		// parameters being parsed may still refer to the text of the ended lexer
+		this->retiredLexers.push_back(this->lexers.front());
 		this->lexers.erase(this->lexers.begin());
 		if (lexers.size() == 0) {
 			throw InputEndedException();
@@ -152,47 +171,24 @@ void PBRTParser::execute_preworld_directives() {
     // When this method starts executing, the first token must be an Identifier of
 	// a directive.
 
-	// parse scene wide rendering options until the WorldBegin statement is met.
-	while (!(this->current_token().type == LexemeType::IDENTIFIER &&
-		this->current_token().value =="WorldBegin")) {
-
-		if (this->current_token().type != LexemeType::IDENTIFIER)
-			throw_syntax_exception("Identifier expected, got " + this->current_token().value + " instead.");
+	// handlers of the scene wide rendering options, indexed by Directive
+	static const DirectiveHandlers handlers = [] {
+		DirectiveHandlers h{};
+		h[(int)Directive::Camera] = [](PBRTParser *p) { p->execute_Camera(); };
+		h[(int)Directive::Film] = [](PBRTParser *p) { p->execute_Film(); };
+		h[(int)Directive::Include] = [](PBRTParser *p) { p->execute_Include(); };
+		h[(int)Directive::Translate] = [](PBRTParser *p) { p->execute_Translate(); };
+		h[(int)Directive::Transform] = [](PBRTParser *p) { p->execute_Transform(); };
+		h[(int)Directive::ConcatTransform] = [](PBRTParser *p) { p->execute_ConcatTransform(); };
+		h[(int)Directive::Scale] = [](PBRTParser *p) { p->execute_Scale(); };
+		h[(int)Directive::Rotate] = [](PBRTParser *p) { p->execute_Rotate(); };
+		h[(int)Directive::LookAt] = [](PBRTParser *p) { p->execute_LookAt(); };
+		return h;
+	}();
 
-		// Scene-Wide rendering options
-		else if (this->current_token().value =="Camera") {
-			this->execute_Camera();
-		}
-		else if (this->current_token().value =="Film"){
-			this->execute_Film();
-		}
-
-		else if (this->current_token().value =="Include") {
-			this->execute_Include();
-		}
-		else if (this->current_token().value =="Translate") {
-			this->execute_Translate();
-		}
-		else if (this->current_token().value =="Transform") {
-			this->execute_Transform();
-		}
-		else if (this->current_token().value =="ConcatTransform") {
-			this->execute_ConcatTransform();
-		}
-		else if (this->current_token().value =="Scale") {
-			this->execute_Scale();
-		}
-		else if (this->current_token().value =="Rotate") {
-			this->execute_Rotate();
-		}
-		else if (this->current_token().value =="LookAt"){
-			this->execute_LookAt();
-		}
-		else {
-			warning_message("Ignoring " + this->current_token().value + " directive..");
-			this->ignore_current_directive();
-		}
-	}
+	// parse scene wide rendering options until the WorldBegin statement is met.
+	while (this->current_token().directive != Directive::WorldBegin)
+		this->dispatch_directive(handlers);
 }
 
 //
@@ -202,8 +198,7 @@ void PBRTParser::execute_world_directives() {
 	this->gState.CTM = ygl::identity_mat4f;
 	this->advance();
 	// parse scene wide rendering options until the WorldBegin statement is met.
-	while (!(this->current_token().type == LexemeType::IDENTIFIER &&
-		this->current_token().value =="WorldEnd")) {
+	while (this->current_token().directive != Directive::WorldEnd) {
 		this->execute_world_directive();
 	}
 }
@@ -214,72 +209,55 @@ void PBRTParser::execute_world_directives() {
 // also inside ObjectBlock.
 //
 void PBRTParser::execute_world_directive() {
+	// handlers of the world directives, indexed by Directive
+	static const DirectiveHandlers handlers = [] {
+		DirectiveHandlers h{};
+		h[(int)Directive::Include] = [](PBRTParser *p) { p->execute_Include(); };
+		h[(int)Directive::Translate] = [](PBRTParser *p) { p->execute_Translate(); };
+		h[(int)Directive::Transform] = [](PBRTParser *p) { p->execute_Transform(); };
+		h[(int)Directive::ConcatTransform] = [](PBRTParser *p) { p->execute_ConcatTransform(); };
+		h[(int)Directive::Scale] = [](PBRTParser *p) { p->execute_Scale(); };
+		h[(int)Directive::Rotate] = [](PBRTParser *p) { p->execute_Rotate(); };
+		h[(int)Directive::LookAt] = [](PBRTParser *p) { p->execute_LookAt(); };
+		h[(int)Directive::AttributeBegin] = [](PBRTParser *p) { p->execute_AttributeBegin(); };
+		h[(int)Directive::TransformBegin] = [](PBRTParser *p) { p->execute_TransformBegin(); };
+		h[(int)Directive::AttributeEnd] = [](PBRTParser *p) { p->execute_AttributeEnd(); };
+		h[(int)Directive::TransformEnd] = [](PBRTParser *p) { p->execute_TransformEnd(); };
+		h[(int)Directive::Shape] = [](PBRTParser *p) { p->execute_Shape(); };
+		h[(int)Directive::ObjectBegin] = [](PBRTParser *p) { p->execute_ObjectBlock(); };
+		h[(int)Directive::ObjectInstance] = [](PBRTParser *p) { p->execute_ObjectInstance(); };
+		h[(int)Directive::LightSource] = [](PBRTParser *p) { p->execute_LightSource(); };
+		h[(int)Directive::AreaLightSource] = [](PBRTParser *p) { p->execute_AreaLightSource(); };
+		h[(int)Directive::Material] = [](PBRTParser *p) { p->execute_Material(false); };
+		h[(int)Directive::MakeNamedMaterial] = [](PBRTParser *p) { p->execute_Material(true); };
+		h[(int)Directive::NamedMaterial] = [](PBRTParser *p) { p->execute_NamedMaterial(); };
+		h[(int)Directive::Texture] = [](PBRTParser *p) { p->execute_Texture(); };
+		return h;
+	}();
+
+	this->dispatch_directive(handlers);
+}
 
-	if (this->current_token().type != LexemeType::IDENTIFIER)
-		throw_syntax_exception("Identifier expected, got " + this->current_token().value + " instead.");
+//
+// dispatch_directive
+// Executes the current directive through the handlers table. Directives without a
+// handler are skipped with a warning. The parameters of the previous directive are
+// released here, resetting the directive arena.
+//
+void PBRTParser::dispatch_directive(const DirectiveHandlers &handlers) {
+	const Lexeme &tok = this->current_token();
+	if (tok.type != LexemeType::IDENTIFIER)
+		throw_syntax_exception("Identifier expected, got " + tok.str() + " instead.");
 
-	if (this->current_token().value =="Include") {
-		this->execute_Include();
-	}
-	else if (this->current_token().value =="Translate") {
-		this->execute_Translate();
-	}
-	else if (this->current_token().value =="Transform") {
-		this->execute_Transform();
-	}
-	else if (this->current_token().value =="ConcatTransform") {
-		this->execute_ConcatTransform();
-	}
-	else if (this->current_token().value =="Scale") {
-		this->execute_Scale();
-	}
-	else if (this->current_token().value =="Rotate") {
-		this->execute_Rotate();
-	}
-	else if (this->current_token().value =="LookAt") {
-		this->execute_LookAt();
-	}
-	else if (this->current_token().value =="AttributeBegin") {
-		this->execute_AttributeBegin();
-	}
-	else if (this->current_token().value =="TransformBegin") {
-		this->execute_TransformBegin();
-	}
-	else if (this->current_token().value =="AttributeEnd") {
-		this->execute_AttributeEnd();
-	}
-	else if (this->current_token().value =="TransformEnd") {
-		this->execute_TransformEnd();
-	}
-	else if (this->current_token().value =="Shape") {
-		this->execute_Shape();
-	}
-	else if (this->current_token().value =="ObjectBegin") {
-		this->execute_ObjectBlock();
-	}
-	else if (this->current_token().value =="ObjectInstance") {
-		this->execute_ObjectInstance();
-	}
-	else if (this->current_token().value =="LightSource") {
-		this->execute_LightSource();
-	}
-	else if (this->current_token().value =="AreaLightSource") {
-		this->execute_AreaLightSource();
-	}
-	else if (this->current_token().value =="Material") {
-		this->execute_Material(false);
-	}
-	else if (this->current_token().value =="MakeNamedMaterial") {
-		this->execute_Material(true);
-	}
-	else if (this->current_token().value =="NamedMaterial") {
-		this->execute_NamedMaterial();
-	}
-	else if (this->current_token().value =="Texture") {
-		this->execute_Texture();
+	this->directiveCounter++;
+	this->retiredLexers.clear();
+	this->directiveArena.reset();
+	DirectiveHandler handler = handlers[(int)tok.directive];
+	if (handler) {
+		handler(this);
 	}
 	else {
-		warning_message("Ignoring " + this->current_token().value + " directive..");
+		warning_message("Ignoring " + tok.str() + " directive..");
 		this->ignore_current_directive();
 	}
 }
@@ -314,133 +292,162 @@ std::string PBRTParser::get_unique_id(CounterID id) {
 // ----------------------------------------------------------------------------
 
 
+// converters from lexemes to parameter values
+static std::string_view lexeme_to_string(const Lexeme &x) { return x.value; }
+static float lexeme_to_float(const Lexeme &x) { return (float)x.number; }
+static int lexeme_to_int(const Lexeme &x) { return (int)x.number; }
+
+//
+// next_word
+// Returns the next word of s separated by spaces, and removes it from s.
+//
+static std::string_view next_word(std::string_view &s) {
+	size_t start = s.find_first_not_of(' ');
+	if (start == std::string_view::npos)
+		start = s.size();
+	size_t end = std::min(s.find(' ', start), s.size());
+	std::string_view word = s.substr(start, end - start);
+	s.remove_prefix(end);
+	return word;
+}
+
 //
 // parse_parameter
 // Fills the PBRTParameter structure with type name and value of the
-// parameter. It is upon to the caller to convert "void * value" to
-// the correct pointer type (by reading the name and type).
+// parameter.
 //
-std::shared_ptr<PBRTParameter> PBRTParser::parse_parameter(){
+PBRTParameter PBRTParser::parse_parameter(){
+	PBRTParameter par = this->parse_parameter_declaration();
+	this->parse_parameter_value(par);
+	return par;
+}
 
-	std::shared_ptr<PBRTParameter> par (new PBRTParameter);
+//
+// parse_parameter_declaration
+// Parse the string with type and name of the parameter.
+//
+PBRTParameter PBRTParser::parse_parameter_declaration() {
 
-	auto valueToString = [](std::string x)->std::string {return x; };
-	auto valueToFloat = [](std::string x)->float {return atof(x.c_str()); };
-	auto valueToInt = [](std::string x)->int {return atoi(x.c_str()); };
+	PBRTParameter par{};
 
 	if (this->current_token().type != LexemeType::STRING)
 		throw_syntax_exception("Expected a string with type and name of a parameter.");
-    
-	auto tokens = split(this->current_token().value);
-    
-	par->type = check_synonyms(std::string(tokens[0]));
-	par->name = tokens[1];
 
-	check_param_type(par->name, par->type);
+	std::string_view decl = this->current_token().value;
+	std::string_view type = check_synonyms(next_word(decl));
+	par.name = next_word(decl);
+	if (par.name.empty())
+		throw_syntax_exception("Expected a string with type and name of a parameter.");
+	par.id = paramTable.lookup(par.name);
+	par.type = (ParamType)(std::find(std::begin(paramTypeNames), std::end(paramTypeNames), type) -
+		std::begin(paramTypeNames));
+
+	check_param_type(par.id, par.type);
 	this->advance();
 
-	// now, according to type, we parse the value
-	if (par->type == "string" || par->type == "texture") {
-		std::vector<std::string> *vals = new std::vector<std::string>();
-		this->parse_value<std::string, LexemeType::STRING>(vals, valueToString);
-		par->value = (void *)vals;
-	}
+	if (par.type == ParamType::Unknown)
+		throw_syntax_exception("Cannot able to parse the value: type '" + std::string(type) + "' not supported.");
+	return par;
+}
 
-	else if (par->type == "float") {
-		std::vector<float> *vals = new std::vector<float>();
-		this->parse_value<float, LexemeType::NUMBER>(vals, valueToFloat);
-		par->value = (void *)vals;
-	}
+//
+// parse_parameter_value
+//
+void PBRTParser::parse_parameter_value(PBRTParameter &par) {
 
-	else if (par->type == "integer") {
-		std::vector<int> *vals = new std::vector<int>();
-		this->parse_value<int, LexemeType::NUMBER>(vals, valueToInt);
-		par->value = (void *)vals;
-	}
-	else if (par->type == "bool") {
-		std::vector<std::string> *vals = new std::vector<std::string>();
-		this->parse_value<std::string, LexemeType::STRING>(vals, valueToString);
-		for (auto v : *vals) {
-			if (v != "false" && v != "true")
+	// now, according to type, we parse the value
+	switch (par.type) {
+	case ParamType::String:
+	case ParamType::Texture:
+		stringScratch.clear();
+		this->parse_value<std::string_view, LexemeType::STRING>(&stringScratch, lexeme_to_string);
+		store_values(par, stringScratch);
+		break;
+
+	case ParamType::Float:
+		floatScratch.clear();
+		this->parse_value<float, LexemeType::NUMBER>(&floatScratch, lexeme_to_float);
+		store_values(par, floatScratch);
+		break;
+
+	case ParamType::Integer:
+		intScratch.clear();
+		this->parse_value<int, LexemeType::NUMBER>(&intScratch, lexeme_to_int);
+		store_values(par, intScratch);
+		break;
+
+	case ParamType::Bool: {
+		stringScratch.clear();
+		this->parse_value<std::string_view, LexemeType::STRING>(&stringScratch, lexeme_to_string);
+		bool *vals = par.allocate_values<bool>(stringScratch.size(), directiveArena);
+		for (size_t i = 0; i < stringScratch.size(); i++) {
+			if (stringScratch[i] != "false" && stringScratch[i] != "true")
 				throw_syntax_exception("A value diffeent from true and false "\
 					"has been given to a bool type parameter.");
+			vals[i] = stringScratch[i] == "true";
 		}
-		par->value = (void *)vals;
+		break;
 	}
 	// now we come at a special case of arrays of vec3f
-	else if (par->type == "point3" || par->type == "normal3"|| par->type == "rgb") {
-		std::unique_ptr<std::vector<float>> vals(new::std::vector<float>());
-		this->parse_value<float, LexemeType::NUMBER>(vals.get(), valueToFloat);
-		if (vals->size() % 3 != 0)
+	case ParamType::Point3:
+	case ParamType::Normal3:
+	case ParamType::RGB: {
+		vectorScratch.clear();
+		int count = this->parse_value<ygl::vec3f, LexemeType::NUMBER, 3>(&vectorScratch, lexeme_to_float);
+		if (count % 3 != 0)
 			throw_syntax_exception("Wrong number of values given.");
-		std::vector<ygl::vec3f> *vectors = new std::vector<ygl::vec3f>();
-		int count = 0;
-		while (count < vals->size()) {
-			ygl::vec3f v;
-			for (int i = 0; i < 3; i++, count++) {
-				v[i] = vals->at(count);
-			}
-			vectors->push_back(v);
-		}
-		par->value = (void *)vectors;
+		store_values(par, vectorScratch);
+		break;
 	}
-	else if (par->type == "spectrum") {
+	case ParamType::Spectrum: {
 		// spectrum data can be given using a file or directly as list
 		std::vector<ygl::vec2f> samples;
 		if (this->current_token().type == LexemeType::STRING) {
 			// filename given
-			std::string fname = this->current_path() + "/" + this->current_token().value;
+			std::string fname = this->current_path() + "/" + this->current_token().str();
 			this->advance();
 			if (!load_spectrum_from_file(fname, samples))
 				throw_syntax_exception("Error loading spectrum data from file.");
 		}else {
-			// step 1: read raw data
-			std::unique_ptr<std::vector<float>> vals(new::std::vector<float>());
-			this->parse_value<float, LexemeType::NUMBER>(vals.get(), valueToFloat);
-			// step 2: pack it in list of vec2f (lambda, val)
-			if (vals->size() % 2 != 0)
+			// read the list of (lambda, val) pairs
+			int count = this->parse_value<ygl::vec2f, LexemeType::NUMBER, 2>(&samples, lexeme_to_float);
+			if (count % 2 != 0)
 				throw_syntax_exception("Wrong number of values given.");
-			int count = 0;
-			while (count < vals->size()) {
-				auto lamb = vals->at(count++);
-				auto v = vals->at(count++);
-				samples.push_back({ lamb, v });
-			}
 		}
-		// step 3: convert to rgb and store in a vector (because it simplifies interface to get data)
-		std::vector<ygl::vec3f> *data = new std::vector<ygl::vec3f>();
-		data->push_back(spectrum_to_rgb(samples));
-		par->value = (void *)data;
-		par->type = std::string("rgb");
+		// convert to rgb
+		*par.allocate_values<ygl::vec3f>(1, directiveArena) = spectrum_to_rgb(samples);
+		par.type = ParamType::RGB;
+		break;
 	}
-	else if (par->type == "blackbody") {
+	case ParamType::Blackbody: {
 		// step 1: read raw data
-		std::unique_ptr<std::vector<float>> vals(new::std::vector<float>());
-		this->parse_value<float, LexemeType::NUMBER>(vals.get(), valueToFloat);
+		floatScratch.clear();
+		this->parse_value<float, LexemeType::NUMBER>(&floatScratch, lexeme_to_float);
 		// step 2: pack it in list of vec2f (lambda, val)
-		if (vals.get()->size() != 2) // NOTE: actually must be % 2 != 0
+		if (floatScratch.size() != 2) // NOTE: actually must be % 2 != 0
 			throw_syntax_exception("Wrong number of values given.");
-		
-		// step 3: convert to rgb and store in a vector (because it simplifies interface to get data)
-		std::vector<ygl::vec3f> *data = new std::vector<ygl::vec3f>();
-		data->push_back(blackbody_to_rgb(vals.get()->at(0), vals.get()->at(1)));
-		par->value = (void *)data;
-		par->type = std::string("rgb");
+
+		// step 3: convert to rgb
+		*par.allocate_values<ygl::vec3f>(1, directiveArena) = blackbody_to_rgb(floatScratch.at(0), floatScratch.at(1));
+		par.type = ParamType::RGB;
+		break;
 	}
-	else {
-		throw_syntax_exception("Cannot able to parse the value: type '" + par->type + "' not supported.");
+	case ParamType::Unknown:
+		// rejected by parse_parameter_definition
+		throw_syntax_exception("Cannot able to parse the value: type not supported.");
 	}
-	return par;
 }
 
 //
 // parse_parameters
 //
-void PBRTParser::parse_parameters(std::vector<std::shared_ptr<PBRTParameter>> &pars) {
+void PBRTParser::parse_parameters(ParameterList &pars) {
+	// most directives have a few parameters, avoid growing the list in the arena.
+	pars.reserve(8);
 	// read parameters
 	while (this->current_token().type != LexemeType::IDENTIFIER) {
 		pars.push_back(this->parse_parameter());
-		
+
 	}
 }
 
@@ -455,12 +462,15 @@ void PBRTParser::execute_Include() {
 	if (this->current_token().type != LexemeType::STRING)
 		throw_syntax_exception("Expected the name of the file to be included.");
 
-	std::string fileToBeIncl = concatenate_paths(this->current_path(), this->current_token().value);
+	std::string fileToBeIncl = concatenate_paths(this->current_path(), this->current_token().str());
 
 	// call advance here on the current lexer is dangerous. It could end the parsing too soon.
 	// better call it in advance() method, directly on the lexter after being
 	// restored.
-	this->lexers.insert(this->lexers.begin(), std::shared_ptr<PBRTLexer>(new PBRTLexer(fileToBeIncl)));
+	std::shared_ptr<PBRTLexer> lexer = this->prefetcher.take(fileToBeIncl);
+	if (!lexer)
+		lexer.reset(new PBRTLexer(fileToBeIncl, this->lexemeCache.get()));
+	this->lexers.insert(this->lexers.begin(), lexer);
 	this->advance(); // this advance is on the new Lexer
 }
 
@@ -478,7 +488,7 @@ void PBRTParser::execute_Translate() {
 	for (int i = 0; i < 3; i++) {
 		if (this->current_token().type != LexemeType::NUMBER)
 			throw_syntax_exception("Expected a float value.");
-		transl_vec[i] = atof(this->current_token().value.c_str());
+		transl_vec[i] = this->current_token().number;
 		this->advance();
 	}
 	
@@ -496,7 +506,7 @@ void PBRTParser::execute_Scale(){
 	for (int i = 0; i < 3; i++) {
 		if (this->current_token().type != LexemeType::NUMBER)
 			throw_syntax_exception("Expected a float value.");
-		scale_vec[i] = atof(this->current_token().value.c_str());
+		scale_vec[i] = this->current_token().number;
 		this->advance();
 	}
 	
@@ -514,7 +524,7 @@ void PBRTParser::execute_Rotate() {
 
 	if (this->current_token().type != LexemeType::NUMBER)
 		throw_syntax_exception("Expected a float value for 'angle' parameter of Rotate directive.");
-	angle = atof(this->current_token().value.c_str());
+	angle = this->current_token().number;
 	angle = angle * (ygl::pif / 180.0f);
 	
 	this->advance();
@@ -522,7 +532,7 @@ void PBRTParser::execute_Rotate() {
 	for (int i = 0; i < 3; i++) {
 		if (this->current_token().type != LexemeType::NUMBER)
 			throw_syntax_exception("Expected a float value.");
-		rot_vec[i] = atof(this->current_token().value.c_str());
+		rot_vec[i] = this->current_token().number;
 		this->advance();
 	}
 	auto rot_mat = ygl::frame_to_mat(ygl::rotation_frame(rot_vec, angle));
@@ -540,7 +550,7 @@ void PBRTParser::execute_LookAt(){
 		for (int j = 0; j < 3; j++) {
 			if (this->current_token().type != LexemeType::NUMBER)
 				throw_syntax_exception("Expected a float value.");
-			vects[i][j] = atof(this->current_token().value.c_str());
+			vects[i][j] = this->current_token().number;
 			this->advance();
 		}
 	}
@@ -559,7 +569,7 @@ void PBRTParser::execute_LookAt(){
 void PBRTParser::execute_Transform() {
 	this->advance();
 	std::vector<float> vals;
-	this->parse_value<float, LexemeType::NUMBER>(&vals, [](std::string x)->float {return atof(x.c_str()); });
+	this->parse_value<float, LexemeType::NUMBER>(&vals, lexeme_to_float);
 	ygl::mat4f nCTM;
 	if (vals.size() != 16)
 		throw_syntax_exception("Wrong number of values given. Expected a 4x4 matrix.");
@@ -578,7 +588,7 @@ void PBRTParser::execute_Transform() {
 void PBRTParser::execute_ConcatTransform() {
 	this->advance();
 	std::vector<float> vals;
-	this->parse_value<float, LexemeType::NUMBER>(&vals, [](std::string x)->float {return atof(x.c_str()); });
+	this->parse_value<float, LexemeType::NUMBER>(&vals, lexeme_to_float);
 	ygl::mat4f nCTM;
 	if (vals.size() != 16)
 		throw_syntax_exception("Wrong number of values given. Expected a 4x4 matrix.");
@@ -620,22 +630,22 @@ void PBRTParser::execute_Camera() {
 	// First parameter is the type
 	if (this->current_token().type != LexemeType::STRING)
 		throw_syntax_exception("Expected type string.");
-	std::string camType = this->current_token().value;
+	std::string camType = this->current_token().str();
 	// RESTRICTION: only perspective camera is supported
 	if (camType != "perspective")
 		throw_syntax_exception("Only perspective camera type is supported.");
 	this->advance();
 
-	std::vector<std::shared_ptr<PBRTParameter>> params;
+	ParameterList params(&directiveArena);
 	this->parse_parameters(params);
 
-	int i_frameaspect = find_param("frameaspectratio", params);
+	int i_frameaspect = find_param(ParamID::frameaspectratio, params);
 	if (i_frameaspect >= 0)
-		cam->aspect = params[i_frameaspect]->get_first_value<float>();
+		cam->aspect = params[i_frameaspect].get_first_value<float>();
 	
-	int i_fov = find_param("fov", params);
+	int i_fov = find_param(ParamID::fov, params);
 	if (i_fov >= 0) {
-		cam->yfov = (params[i_fov]->get_first_value<float>())*ygl::pif / 180;
+		cam->yfov = (params[i_fov].get_first_value<float>())*ygl::pif / 180;
 	}
 		
 	scn->cameras.push_back(cam);
@@ -650,7 +660,7 @@ void PBRTParser::execute_Film() {
 	// First parameter is the type
 	if (this->current_token().type != LexemeType::STRING)
 		throw_syntax_exception("Expected type string.");
-	std::string filmType = this->current_token().value;
+	std::string filmType = this->current_token().str();
 	
 	if (filmType != "image")
 		throw_syntax_exception("Only image \"film\" is supported.");
@@ -659,16 +669,16 @@ void PBRTParser::execute_Film() {
 	int xres = 0;
 	int yres = 0;
 
-	std::vector<std::shared_ptr<PBRTParameter>> params;
+	ParameterList params(&directiveArena);
 	this->parse_parameters(params);
 
-	int i_xres = find_param("xresolution", params);
+	int i_xres = find_param(ParamID::xresolution, params);
 	if (i_xres >= 0)
-		xres = params[i_xres]->get_first_value<int>();
+		xres = params[i_xres].get_first_value<int>();
 
-	int i_yres = find_param("yresolution", params);
+	int i_yres = find_param(ParamID::yresolution, params);
 	if (i_yres >= 0)
-		yres = params[i_yres]->get_first_value<int>();
+		yres = params[i_yres].get_first_value<int>();
 
 	if (xres && yres) {
 		auto asp = ((float)xres) / ((float)yres);
@@ -693,6 +703,8 @@ void PBRTParser::execute_AttributeBegin() {
 	this->advance();
 	// save the current state
 	stateStack.push_back(this->gState);
+	nameToTexture.push_scope();
+	nameToMaterial.push_scope();
 }
 
 //
@@ -705,6 +717,8 @@ void PBRTParser::execute_AttributeEnd() {
 	}
 	this->gState = stateStack.back();
 	stateStack.pop_back();
+	nameToTexture.pop_scope();
+	nameToMaterial.pop_scope();
 }
 
 //
@@ -746,74 +760,70 @@ void PBRTParser::parse_cube(ygl::shape *shp) {
 
 //
 // parse_triangle_mesh
+// Vertex data and indices are parsed straight into the shape buffers, the
+// other parameters are parsed as usual.
 //
-void PBRTParser::parse_trianglemesh(ygl::shape *shp) {
+void PBRTParser::parse_trianglemesh(ShapeJob &job) {
+	ygl::shape *shp = job.shp;
 
 	bool indicesCheck = false;
 	bool PCheck = false;
+	bool NCheck = false;
+	bool uvCheck = false;
+	bool stCheck = false;
+	int indicesCount = 0;
 
-	std::vector<std::shared_ptr<PBRTParameter>> params;
-	this->parse_parameters(params);
-	// vertices
-	int i_p = find_param("P", params);
-	if (i_p >= 0) {
-		auto data = (std::vector<ygl::vec3f> *) params[i_p]->value;
-		for (auto p : *data) {
-			shp->pos.push_back(p);
+	ParameterList params(&directiveArena);
+	while (this->current_token().type != LexemeType::IDENTIFIER) {
+		PBRTParameter par = this->parse_parameter_declaration();
+		// vertices
+		if (par.id == ParamID::P && !PCheck) {
+			int count = this->parse_value<ygl::vec3f, LexemeType::NUMBER, 3>(&shp->pos, lexeme_to_float);
+			if (count % 3 != 0)
+				throw_syntax_exception("Wrong number of values given.");
+			PCheck = true;
 		}
-		PCheck = true;
-
-	}
-	// normals
-	int i_N = find_param("N", params);
-	if (i_N >= 0) {
-		auto data = (std::vector<ygl::vec3f> *) params[i_N]->value;
-		for (auto p : *data) {
-			shp->norm.push_back(p);
+		// normals
+		else if (par.id == ParamID::N && !NCheck) {
+			int count = this->parse_value<ygl::vec3f, LexemeType::NUMBER, 3>(&shp->norm, lexeme_to_float);
+			if (count % 3 != 0)
+				throw_syntax_exception("Wrong number of values given.");
+			NCheck = true;
 		}
-	}
-	// indices
-	int i_indices = find_param("indices", params);
-	if (i_indices >= 0) {
-		std::vector<int> *data = (std::vector<int> *) params[i_indices]->value;
-		if (data->size() % 3 != 0) {
-			delete shp;
-			throw_syntax_exception("The number of triangle vertices must be multiple of 3.");
+		// indices
+		else if (par.id == ParamID::indices && !indicesCheck) {
+			indicesCount = this->parse_value<ygl::vec3i, LexemeType::NUMBER, 3>(&shp->triangles, lexeme_to_int);
+			indicesCheck = true;
 		}
-			
-
-		int count = 0;
-		while (count < data->size()) {
-			ygl::vec3i triangle;
-			triangle[0] = data->at(count++);
-			triangle[1] = data->at(count++);
-			triangle[2] = data->at(count++);
-			shp->triangles.push_back(triangle);
+		// texture coordinates: uv is preferred to st, whatever their order
+		else if (((par.id == ParamID::uv && !uvCheck) || (par.id == ParamID::st && !uvCheck && !stCheck)) &&
+			par.type == ParamType::Float) {
+			shp->texcoord.clear();
+			int count = this->parse_value<ygl::vec2f, LexemeType::NUMBER, 2>(&shp->texcoord, lexeme_to_float);
+			if (count % 2 != 0)
+				throw_syntax_exception("Wrong number of values given.");
+			if (par.id == ParamID::uv)
+				uvCheck = true;
+			else
+				stCheck = true;
 		}
-		indicesCheck = true;
-	}
-
-	int i_uv = find_param("uv", params);
-	if (i_uv == -1)
-		i_uv = find_param("st", params);
-	if(i_uv >= 0){
-		std::vector<float> *data = (std::vector<float> *)params[i_uv]->value;
-		int j = 0;
-		while (j < data->size()) {
-			ygl::vec2f uv;
-			uv[0] = data->at(j++);
-			uv[1] = data->at(j++);
-			shp->texcoord.push_back(uv);
+		else {
+			this->parse_parameter_value(par);
+			params.push_back(std::move(par));
 		}
 	}
-	
+
+	if (indicesCount % 3 != 0) {
+		delete shp;
+		throw_syntax_exception("The number of triangle vertices must be multiple of 3.");
+	}
+
 	// TODO: materials parameters overriding
 	// Single material parameters (e.g. Kd, Ks) can be directly specified on a shape
 	// overriding (for this shape) the value of the current material in the graphical state.
 
-	// TODO: solve problem with normals
-	if (shp->norm.size() == 0);
-		my_compute_normals(shp->triangles, shp->pos, shp->norm, true);
+	if (shp->norm.size() == 0)
+		job.computeNormals = true;
 
 	if (!(indicesCheck && PCheck)) {
 		delete shp;
@@ -830,11 +840,17 @@ void PBRTParser::execute_Shape() {
 	// parse the shape name
 	if (this->current_token().type != LexemeType::STRING)
 		throw_syntax_exception("Expected shape name.");
-	std::string shapeName = this->current_token().value;
+	std::string shapeName = this->current_token().str();
 	this->advance();
 	
 	ygl::shape *shp = new ygl::shape();
 	shp->name = get_unique_id(CounterID::shape);
+	ShapeJob job;
+	job.shp = shp;
+	job.uscale = gState.uscale;
+	job.weldEpsilon = this->weldEpsilon;
+	job.optimizeCache = this->optimizeVertexCache;
+	job.vscale = gState.vscale;
 	// add material to shape
 	if (!gState.mat) {
 		// since no material was defined, empty material is created
@@ -859,18 +875,18 @@ void PBRTParser::execute_Shape() {
 	}
 
 	else if (shapeName == "trianglemesh")
-		this->parse_trianglemesh(shp);
+		this->parse_trianglemesh(job);
 
 	else if (shapeName == "cube")
 		this->parse_cube(shp);
 	
 	else if (shapeName == "sphere") {
-		std::vector<std::shared_ptr<PBRTParameter>> params;
+		ParameterList params(&directiveArena);
 		this->parse_parameters(params);
 		float radius = 1;
-		int i_rad = find_param("radius", params);
+		int i_rad = find_param(ParamID::radius, params);
 		if (i_rad >= 0) {
-			radius = params[i_rad]->get_first_value<float>();
+			radius = params[i_rad].get_first_value<float>();
 		}
 		ygl::make_uvspherizedcube(shp->quads, shp->pos, shp->norm, shp->texcoord, 4, radius);
 	}
@@ -883,19 +899,17 @@ void PBRTParser::execute_Shape() {
 		
 	}
 	else if (shapeName == "plymesh"){
-		std::shared_ptr<PBRTParameter> par = this->parse_parameter();
+		PBRTParameter par = this->parse_parameter();
 
-		if (par->name != "filename") {
+		if (par.id != ParamID::filename) {
 			delete shp;
 			throw_syntax_exception("Expected ply file path.");
 		}
 			
-		std::string fname = this->current_path() + "/" + par->get_first_value<std::string>();
-
-		if (!parse_ply(fname, shp)){
-			delete shp;
-			throw_syntax_exception("Error parsing ply file: " + fname);
-		}
+		// the file is loaded in background, see build_shapes
+		job.plyFilename = this->current_path() + "/" + par.get_first_value<std::string>();
+		job.sourceFile = this->current_file();
+		job.sourcePos = this->lexers.at(0)->get_position();
 
 		while (this->current_token().type != LexemeType::IDENTIFIER)
 			this->advance();
@@ -908,12 +922,6 @@ void PBRTParser::execute_Shape() {
 		return;
 	}
 
-	// handle texture coordinate scaling
-	for (int i = 0; i < shp->texcoord.size(); i++) {
-		shp->texcoord[i].x *= gState.uscale;
-		shp->texcoord[i].y *= gState.vscale;
-	}
-
 	// add shp in scene
 	ygl::shape_group *sg = new ygl::shape_group;
 	sg->shapes.push_back(shp);
@@ -932,7 +940,87 @@ void PBRTParser::execute_Shape() {
 		inst->frame = ygl::mat_to_frame(this->gState.CTM);
 		inst->name = get_unique_id(CounterID::instance);
 		scn->instances.push_back(inst);
+		// the shape can be replaced by an identical one, see dedup_shapes
+		if (this->dedupShapes) {
+			job.group = sg;
+			job.inst = inst;
+			job.hashContent = true;
+		}
 	}
+
+	this->shapeJobs.push_back(std::move(job));
+	if (!this->shapeJobs.back().plyFilename.empty())
+		this->shapeLoader.load(&this->shapeJobs.back());
+}
+
+//
+// build_shapes
+// Completes the shapes recorded while parsing: waits for the ply files being
+// loaded, then runs the other jobs on the thread pool. Names, materials
+// and transforms were all assigned during parsing, so the scene does not depend
+// on the order the jobs are run. If some ply files could not be loaded, the
+// first failure in scene order is reported.
+//
+void PBRTParser::build_shapes() {
+	// the includes have all been read
+	this->prefetcher.cancel();
+	this->shapeLoader.wait();
+	this->pool.parallel_for(this->shapeJobs.size(), [this](size_t i) {
+		if (!this->shapeJobs[i].done)
+			build_shape(this->shapeJobs[i], &this->pool);
+	});
+	for (auto &job : this->shapeJobs) {
+		if (job.failed) {
+			std::cerr << job.log;
+			throw_syntax_exception("Error parsing ply file: " + job.plyFilename, location_of(job.sourceFile, job.sourcePos));
+		}
+		this->weldSavedBytes += job.weldSavedBytes;
+		if (job.optimizeCache && job.cacheStats.triangles > 0)
+			this->vertexCacheReport.push_back({ job.shp->name, job.cacheStats });
+	}
+	if (this->dedupShapes)
+		this->dedup_shapes();
+	this->shapeJobs.clear();
+}
+
+//
+// dedup_shapes
+// Shapes with the same content and material, each with its own instance, are
+// merged: the instances of the duplicates refer to the shape group of the first
+// one in scene order, and the other groups are removed from the scene. The
+// content hashes only select the candidates, the buffers are then compared.
+//
+void PBRTParser::dedup_shapes() {
+	std::unordered_map<uint64_t, std::vector<ShapeJob *>> buckets;
+	std::unordered_set<ygl::shape_group *> removed;
+	for (auto &job : this->shapeJobs) {
+		if (!job.hashContent)
+			continue;
+		ygl::shape *shp = job.group->shapes[0];
+		uint64_t key = hash_bytes(&shp->mat, sizeof(shp->mat), job.contentHash);
+		auto &candidates = buckets[key];
+		ShapeJob *original = nullptr;
+		for (auto c : candidates) {
+			if (c->group->shapes[0]->mat == shp->mat && same_shape(c->group->shapes[0], shp)) {
+				original = c;
+				break;
+			}
+		}
+		if (!original) {
+			candidates.push_back(&job);
+			continue;
+		}
+		job.inst->shp = original->group;
+		removed.insert(job.group);
+	}
+	if (removed.empty())
+		return;
+	auto &shapes = this->scn->shapes;
+	shapes.erase(std::remove_if(shapes.begin(), shapes.end(), [&removed](ygl::shape_group *sg) {
+		return removed.count(sg) > 0;
+	}), shapes.end());
+	for (auto sg : removed)
+		delete sg;
 }
 
 // ------------------- END SHAPES --------------------------------------------------
@@ -946,17 +1034,15 @@ void PBRTParser::execute_ObjectBlock() {
 	this->execute_AttributeBegin(); // it will execute advance() too
 	this->inObjectDefinition = true;
 	this->shapesInObject.clear();
-	int start = this->lexers[0]->get_line();
 
 	if (this->current_token().type != LexemeType::STRING)
 		throw_syntax_exception("Expected object name as a string.");
 	//NOTE: the current transformation matrix defines the transformation from
 	//object space to instance's coordinate space
-	std::string objName = this->current_token().value;
+	std::string objName = this->current_token().str();
 	this->advance();
 
-	while (!(this->current_token().type == LexemeType::IDENTIFIER &&
-		this->current_token().value == "ObjectEnd")){
+	while (this->current_token().directive != Directive::ObjectEnd) {
 		this->execute_world_directive();
 	}
 
@@ -982,7 +1068,7 @@ void PBRTParser::execute_ObjectInstance() {
 		throw_syntax_exception("Expected object name as a string.");
 	//NOTE: the current transformation matrix defines the transformation from
 	//instance space to world coordinate space
-	std::string objName = this->current_token().value;
+	std::string objName = this->current_token().str();
 	this->advance();
 
 	auto obj = nameToObject.find(objName);
@@ -1020,7 +1106,7 @@ void PBRTParser::execute_LightSource() {
 	this->advance();
 	if (this->current_token().type != LexemeType::STRING)
 		throw_syntax_exception("Expected lightsource type as a string.");
-	std::string lightType = this->current_token().value;
+	std::string lightType = this->current_token().str();
 	this->advance();
 
 	if (lightType == "point")
@@ -1043,20 +1129,20 @@ void PBRTParser::parse_InfiniteLight() {
 	ygl::vec3f L { 1, 1, 1 };
 	std::string mapname;
 
-	std::vector<std::shared_ptr<PBRTParameter>> params;
+	ParameterList params(&directiveArena);
 	this->parse_parameters(params);
 
-	int i_scale = find_param("scale", params);
+	int i_scale = find_param(ParamID::scale, params);
 	if (i_scale >= 0) {
-		scale = params[i_scale]->get_first_value<ygl::vec3f>();
+		scale = params[i_scale].get_first_value<ygl::vec3f>();
 	}
-	int i_L = find_param("L", params);
+	int i_L = find_param(ParamID::L, params);
 	if (i_L >= 0) {
-		L = params[i_L]->get_first_value<ygl::vec3f>();
+		L = params[i_L].get_first_value<ygl::vec3f>();
 	}
-	int i_map = find_param("mapname", params);
+	int i_map = find_param(ParamID::mapname, params);
 	if (i_map >= 0) {
-		mapname = params[i_map]->get_first_value<std::string>();
+		mapname = params[i_map].get_first_value<std::string>();
 	}
 	
 	ygl::environment *env = new ygl::environment;
@@ -1090,20 +1176,20 @@ void PBRTParser::parse_PointLight() {
 	ygl::vec3f I{ 1, 1, 1 };
 	ygl::vec3f point;
 
-	std::vector<std::shared_ptr<PBRTParameter>> params;
+	ParameterList params(&directiveArena);
 	this->parse_parameters(params);
 
-	int i_scale = find_param("scale", params);
+	int i_scale = find_param(ParamID::scale, params);
 	if (i_scale >= 0) {
-		scale = params[i_scale]->get_first_value<ygl::vec3f>();
+		scale = params[i_scale].get_first_value<ygl::vec3f>();
 	}
-	int i_I = find_param("I", params);
+	int i_I = find_param(ParamID::I, params);
 	if (i_I >= 0) {
-		I = params[i_I]->get_first_value<ygl::vec3f>();
+		I = params[i_I].get_first_value<ygl::vec3f>();
 	}
-	int i_from = find_param("from", params);
+	int i_from = find_param(ParamID::from, params);
 	if (i_from >= 0) {
-		point = params[i_from]->get_first_value<ygl::vec3f>();
+		point = params[i_from].get_first_value<ygl::vec3f>();
 	}
 
 	ygl::shape_group *sg = new ygl::shape_group;
@@ -1141,7 +1227,7 @@ void PBRTParser::execute_AreaLightSource() {
 	if (this->current_token().type != LexemeType::STRING)
 		throw_syntax_exception("Expected lightsource type as a string.");
 	
-	std::string areaLightType = this->current_token().value;
+	std::string areaLightType = this->current_token().str();
 	// TODO: check type
 	this->advance();
 
@@ -1149,21 +1235,21 @@ void PBRTParser::execute_AreaLightSource() {
 	ygl::vec3f L{ 1, 1, 1 };
 	bool twosided = false;
 
-	std::vector<std::shared_ptr<PBRTParameter>> params;
+	ParameterList params(&directiveArena);
 	this->parse_parameters(params);
 	
-	int i_scale = find_param("scale", params);
+	int i_scale = find_param(ParamID::scale, params);
 	if (i_scale >= 0) {
-		scale = params[i_scale]->get_first_value<ygl::vec3f>();
+		scale = params[i_scale].get_first_value<ygl::vec3f>();
 	}
-	int i_L = find_param("L", params);
+	int i_L = find_param(ParamID::L, params);
 	if (i_L >= 0) {
-		L = params[i_L]->get_first_value<ygl::vec3f>();
+		L = params[i_L].get_first_value<ygl::vec3f>();
 	}
 	
-	int i_ts = find_param("twosided", params);
+	int i_ts = find_param(ParamID::twosided, params);
 	if (i_ts >= 0) {
-		twosided =params[i_ts]->get_first_value<std::string>() == "true" ? true : false;
+		twosided = params[i_ts].get_first_value<bool>();
 	}
 	
 	this->gState.areaLight.active = true;
@@ -1190,33 +1276,33 @@ void PBRTParser::execute_Material(bool namedMaterial) {
 		if (this->current_token().type != LexemeType::STRING)
 			throw_syntax_exception("Expected material name as string.");
 
-		materialName = this->current_token().value;
-		if (gState.nameToMaterial.find(materialName) != gState.nameToMaterial.end())
+		materialName = this->current_token().str();
+		if (nameToMaterial.find(materialName))
 			throw_syntax_exception("A material with the specified name already exists.");
 		this->advance();
 	}
 	else {
 		if (this->current_token().type != LexemeType::STRING)
 			throw_syntax_exception("Expected material type as a string.");
-		materialType = this->current_token().value;
+		materialType = this->current_token().str();
 		this->advance();
 	}
 
-	std::vector<std::shared_ptr<PBRTParameter>> params{};
+	ParameterList params(&directiveArena);
 	this->parse_parameters(params);
 
 	if (namedMaterial) {
-		int i_mtype = find_param("type", params);
+		int i_mtype = find_param(ParamID::type, params);
 		if (i_mtype < 0)
 			throw_syntax_exception("Expected type of named material.");
 		else
-			materialType = params[i_mtype]->get_first_value<std::string>();
+			materialType = params[i_mtype].get_first_value<std::string>();
 	}
 
 	// bump is common to every material
-	int i_bump = find_param("bump", params);
+	int i_bump = find_param(ParamID::bump, params);
 	if (i_bump >= 0) {
-		auto txtName = params[i_bump]->get_first_value<std::string>();
+		auto txtName = params[i_bump].get_first_value<std::string>();
 		auto dbump = texture_lookup(txtName, true);
 		dmat->mat->bump_txt = dbump->txt;
 		gState.uscale = dbump->uscale;
@@ -1246,7 +1332,7 @@ void PBRTParser::execute_Material(bool namedMaterial) {
 		this->parse_material_matte(dmat, params);
 	}
 	if (namedMaterial)
-		gState.nameToMaterial.insert(std::make_pair(materialName, dmat));
+		nameToMaterial.set(materialName, dmat);
 	else
 		this->gState.mat = dmat;
 }
@@ -1258,22 +1344,22 @@ void PBRTParser::execute_NamedMaterial() {
 	this->advance();
 	if (this->current_token().type != LexemeType::STRING)
 		throw_syntax_exception("Expected material name string.");
-	std::string materialName = this->current_token().value;
+	std::string materialName = this->current_token().str();
 	this->advance();
-	auto it = gState.nameToMaterial.find(materialName);
-	if (it == gState.nameToMaterial.end())
+	auto dmat = nameToMaterial.find(materialName);
+	if (!dmat)
 		throw_syntax_exception("No material with the specified name.");
-	this->gState.mat = it->second;
+	this->gState.mat = *dmat;
 }
 
 //
 // parse_material_matte
 //
-void PBRTParser::parse_material_matte(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params) {
+void PBRTParser::parse_material_matte(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params) {
 	dmat->mat->kd = { 0.5f, 0.5f, 0.5f };
 	dmat->mat->rs = 1;
 	
-	int i_kd = find_param("Kd", params);
+	int i_kd = find_param(ParamID::Kd, params);
 	if (i_kd >= 0) {
 		set_k_property(params[i_kd], dmat->mat->kd, &(dmat->mat->kd_txt));
 	}
@@ -1282,36 +1368,36 @@ void PBRTParser::parse_material_matte(std::shared_ptr<DeclaredMaterial> &dmat, s
 //
 // parse_material_uber
 //
-void PBRTParser::parse_material_uber(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params) {
+void PBRTParser::parse_material_uber(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params) {
 	dmat->mat->kd = { 0.25f, 0.25f, 0.25f };
 	dmat->mat->ks = { 0.25f, 0.25f, 0.25f };
 	dmat->mat->kr = { 0, 0, 0 };
 	dmat->mat->rs = 0.01f;
 
-	int i_kd = find_param("Kd", params);
+	int i_kd = find_param(ParamID::Kd, params);
 	if (i_kd >= 0) {
 		set_k_property(params[i_kd], dmat->mat->kd, &(dmat->mat->kd_txt));
 	}
 
-	int i_ks = find_param("Ks", params);
+	int i_ks = find_param(ParamID::Ks, params);
 	if (i_ks >= 0) {
 		set_k_property(params[i_ks], dmat->mat->ks, &(dmat->mat->ks_txt));
 	}
 
-	int i_kr = find_param("Kr", params);
+	int i_kr = find_param(ParamID::Kr, params);
 	if (i_kr >= 0) {
 		set_k_property(params[i_kr], dmat->mat->kr, &(dmat->mat->kr_txt));
 	}
 
-	int i_rs = find_param("roughness", params);
+	int i_rs = find_param(ParamID::roughness, params);
 	if (i_rs >= 0) {
-		if (params[i_rs]->type == "texture") {
-			auto txtName = params[i_rs]->get_first_value<std::string>();
+		if (params[i_rs].type == ParamType::Texture) {
+			auto txtName = params[i_rs].get_first_value<std::string>();
 			dmat->mat->rs_txt = texture_lookup(txtName, true)->txt;
 			dmat->mat->rs = 1;	
 		}
 		else {
-			dmat->mat->rs = params[i_rs]->get_first_value<float>();
+			dmat->mat->rs = params[i_rs].get_first_value<float>();
 		}
 	}
 	
@@ -1320,42 +1406,42 @@ void PBRTParser::parse_material_uber(std::shared_ptr<DeclaredMaterial> &dmat, st
 //
 // parse_material_translucent
 //
-void PBRTParser::parse_material_translucent(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params) {
+void PBRTParser::parse_material_translucent(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params) {
 	dmat->mat->kd = { 0.25f, 0.25f, 0.25f };
 	dmat->mat->ks = { 0.25f, 0.25f, 0.25f };
 	dmat->mat->kr = { 0.5f, 0.5f, 0.5f };
 	dmat->mat->kt = { 0.5f, 0.5f, 0.5f };
 	dmat->mat->rs = 0.1f;
 	
-	int i_kr = find_param("Kr", params);
+	int i_kr = find_param(ParamID::Kr, params);
 	if (i_kr >= 0) {
 		set_k_property(params[i_kr], dmat->mat->kr, &(dmat->mat->kr_txt));
 	}
 
-	int i_kd = find_param("Kd", params);
+	int i_kd = find_param(ParamID::Kd, params);
 	if (i_kd >= 0) {
 		set_k_property(params[i_kd], dmat->mat->kd, &(dmat->mat->kd_txt));
 	}
 
-	int i_ks = find_param("Ks", params);
+	int i_ks = find_param(ParamID::Ks, params);
 	if (i_ks >= 0) {
 		set_k_property(params[i_ks], dmat->mat->ks, &(dmat->mat->ks_txt));
 	}
 
-	int i_kt = find_param("Kt", params);
+	int i_kt = find_param(ParamID::Kt, params);
 	if (i_kt >= 0) {
 		set_k_property(params[i_kt], dmat->mat->kt, &(dmat->mat->kt_txt));
 	}
 
-	int i_rs = find_param("roughness", params);
+	int i_rs = find_param(ParamID::roughness, params);
 	if (i_rs >= 0) {
-		if (params[i_rs]->type == "texture") {
-			auto txtName = params[i_rs]->get_first_value<std::string>();
+		if (params[i_rs].type == ParamType::Texture) {
+			auto txtName = params[i_rs].get_first_value<std::string>();
 			dmat->mat->rs_txt = texture_lookup(txtName, true)->txt;
 			dmat->mat->rs = 1;
 		}
 		else {
-			dmat->mat->rs = params[i_rs]->get_first_value<float>();
+			dmat->mat->rs = params[i_rs].get_first_value<float>();
 		}
 	}
 }
@@ -1363,31 +1449,31 @@ void PBRTParser::parse_material_translucent(std::shared_ptr<DeclaredMaterial> &d
 //
 // parser_material_metal
 //
-void PBRTParser::parse_material_metal(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params) {
+void PBRTParser::parse_material_metal(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params) {
 	ygl::vec3f eta{ 0.5, 0.5, 0.5 };
 	ygl::texture *etaTexture = nullptr;
 	ygl::vec3f k { 0.5, 0.5, 0.5 };
 	ygl::texture *kTexture = nullptr;
 	dmat->mat->rs = 0.01;
 
-	int i_eta = find_param("eta", params);
+	int i_eta = find_param(ParamID::eta, params);
 	if (i_eta >= 0) {
 		set_k_property(params[i_eta], eta, &(etaTexture));
 	}
-	int i_k = find_param("k", params);
+	int i_k = find_param(ParamID::k, params);
 	if (i_k >= 0) {
 		set_k_property(params[i_k], k, &(kTexture));
 	}
 	
-	int i_rs = find_param("roughness", params);
+	int i_rs = find_param(ParamID::roughness, params);
 	if (i_rs >= 0) {
-		if (params[i_rs]->type == "texture") {
-			auto txtName = params[i_rs]->get_first_value<std::string>();
+		if (params[i_rs].type == ParamType::Texture) {
+			auto txtName = params[i_rs].get_first_value<std::string>();
 			dmat->mat->rs_txt = texture_lookup(txtName, true)->txt;
 			dmat->mat->rs = 1;
 		}
 		else {
-			dmat->mat->rs = params[i_rs]->get_first_value<float>();
+			dmat->mat->rs = params[i_rs].get_first_value<float>();
 		}
 	}
 	dmat->mat->ks = ygl::fresnel_metal(1, eta, k);
@@ -1396,10 +1482,10 @@ void PBRTParser::parse_material_metal(std::shared_ptr<DeclaredMaterial> &dmat, s
 //
 // parse_material_mirror
 //
-void PBRTParser::parse_material_mirror(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params) {
+void PBRTParser::parse_material_mirror(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params) {
 	dmat->mat->kr = { 0.9f, 0.9f, 0.9f };
 	dmat->mat->rs = 0;
-	int i_kr = find_param("Kr", params);
+	int i_kr = find_param(ParamID::Kr, params);
 	if (i_kr >= 0) {
 		set_k_property(params[i_kr], dmat->mat->kr, &(dmat->mat->kr_txt));
 	}
@@ -1408,17 +1494,17 @@ void PBRTParser::parse_material_mirror(std::shared_ptr<DeclaredMaterial> &dmat,
 //
 // parse_material_plastic
 //
-void PBRTParser::parse_material_plastic(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params) {
+void PBRTParser::parse_material_plastic(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params) {
 	dmat->mat->kd = { 0.25, 0.25, 0.25 };
 	dmat->mat->ks = { 0.25, 0.25, 0.25 };
 	dmat->mat->rs = 0.1;
 	
-	int i_kd = find_param("Kd", params);
+	int i_kd = find_param(ParamID::Kd, params);
 	if (i_kd >= 0) {
 		set_k_property(params[i_kd], dmat->mat->kd, &(dmat->mat->kd_txt));
 	}
 
-	int i_ks = find_param("Ks", params);
+	int i_ks = find_param(ParamID::Ks, params);
 	if (i_ks >= 0) {
 		set_k_property(params[i_ks], dmat->mat->ks, &(dmat->mat->ks_txt));
 	}
@@ -1427,17 +1513,17 @@ void PBRTParser::parse_material_plastic(std::shared_ptr<DeclaredMaterial> &dmat,
 //
 // parse_material_substrate
 //
-void PBRTParser::parse_material_substrate(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params) {
+void PBRTParser::parse_material_substrate(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params) {
 	dmat->mat->kd = { 0.5, 0.5, 0.5 };
 	dmat->mat->ks = { 0.5, 0.5, 0.5 };
 	dmat->mat->rs = 0;
 	
-	int i_kd = find_param("Kd", params);
+	int i_kd = find_param(ParamID::Kd, params);
 	if (i_kd >= 0) {
 		set_k_property(params[i_kd], dmat->mat->kd, &(dmat->mat->kd_txt));
 	}
 
-	int i_ks = find_param("Ks", params);
+	int i_ks = find_param(ParamID::Ks, params);
 	if (i_ks >= 0) {
 		set_k_property(params[i_ks], dmat->mat->ks, &(dmat->mat->ks_txt));
 	}
@@ -1446,17 +1532,17 @@ void PBRTParser::parse_material_substrate(std::shared_ptr<DeclaredMaterial> &dma
 //
 // parse_material_glass
 //
-void PBRTParser::parse_material_glass(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params) {
+void PBRTParser::parse_material_glass(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params) {
 	dmat->mat->ks = { 0.04f, 0.04f, 0.04f };
 	dmat->mat->kt = { 1, 1, 1 };
 	dmat->mat->rs = 0.1;
 	
-	int i_ks = find_param("Ks", params);
+	int i_ks = find_param(ParamID::Ks, params);
 	if (i_ks >= 0) {
 		set_k_property(params[i_ks], dmat->mat->ks, &(dmat->mat->ks_txt));
 	}
 
-	int i_kt = find_param("Kt", params);
+	int i_kt = find_param(ParamID::Kt, params);
 	if (i_kt >= 0) {
 		set_k_property(params[i_kt], dmat->mat->kt, &(dmat->mat->kt_txt));
 	}
@@ -1526,24 +1612,24 @@ ygl::texture* PBRTParser::blend_textures(ygl::texture *txt1, ygl::texture *txt2,
 //
 // parse_material_mix
 //
-void PBRTParser::parse_material_mix(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params) {
+void PBRTParser::parse_material_mix(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params) {
 	
 	float amount = 0.5f;
 	std::string m1, m2;
-	int i_am = find_param("amount", params);
+	int i_am = find_param(ParamID::amount, params);
 	if (i_am >= 0) {
-		amount = params[i_am]->get_first_value<float>();
+		amount = params[i_am].get_first_value<float>();
 	}
-	int i_m1 = find_param("namedmaterial1", params);
+	int i_m1 = find_param(ParamID::namedmaterial1, params);
 	if (i_m1 >= 0) {
-		m1 = params[i_m1]->get_first_value<std::string>();
+		m1 = params[i_m1].get_first_value<std::string>();
 	}
 	else {
 		throw_syntax_exception("Missing namedmaterial1.");
 	}
-	int i_m2 = find_param("namedmaterial2", params);
+	int i_m2 = find_param(ParamID::namedmaterial2, params);
 	if (i_m2 >= 0) {
-		m2 = params[i_m2]->get_first_value<std::string>();
+		m2 = params[i_m2].get_first_value<std::string>();
 	}
 	else {
 		throw_syntax_exception("Missing namedmaterial2.");
@@ -1575,16 +1661,16 @@ void PBRTParser::parse_material_mix(std::shared_ptr<DeclaredMaterial> &dmat, std
 // set_k_property
 // Convenience function to set kd, ks, kt, kr from parsed parameter
 //
-void PBRTParser::set_k_property(std::shared_ptr<PBRTParameter> &par, ygl::vec3f &k, ygl::texture **txt) {
-	if (par->type == "texture") {
-		auto declTexture = texture_lookup(par->get_first_value<std::string>(), true);
+void PBRTParser::set_k_property(const PBRTParameter &par, ygl::vec3f &k, ygl::texture **txt) {
+	if (par.type == ParamType::Texture) {
+		auto declTexture = texture_lookup(par.get_first_value<std::string>(), true);
 		*txt = declTexture->txt;
 		gState.uscale = declTexture->uscale;
 		gState.vscale = declTexture->vscale;
 		k = { 1, 1, 1 };
 	}
 	else {
-		k = par->get_first_value<ygl::vec3f>();
+		k = par.get_first_value<ygl::vec3f>();
 	}
 }
 
@@ -1616,20 +1702,20 @@ void PBRTParser::parse_imagemap_texture(std::shared_ptr<DeclaredTexture> &dt) {
 	
 	std::string filename = "";
 	// read parameters
-	std::vector<std::shared_ptr<PBRTParameter>> params{};
+	ParameterList params(&directiveArena);
 	this->parse_parameters(params);
 
-	int i_u = find_param("uscale", params);
+	int i_u = find_param(ParamID::uscale, params);
 	if (i_u >= 0)
-		dt->uscale = params[i_u]->get_first_value<float>();
+		dt->uscale = params[i_u].get_first_value<float>();
 
-	int i_v = find_param("vscale", params);
+	int i_v = find_param(ParamID::vscale, params);
 	if (i_v >= 0)
-		dt->vscale = params[i_v]->get_first_value<float>();
+		dt->vscale = params[i_v].get_first_value<float>();
 	
-	int i_fn = find_param("filename", params);
+	int i_fn = find_param(ParamID::filename, params);
 	if (i_fn >= 0) {
-		filename = params[i_fn]->get_first_value<std::string>();
+		filename = params[i_fn].get_first_value<std::string>();
 	}
 	else {
 		throw_syntax_exception("No texture filename provided.");
@@ -1649,19 +1735,19 @@ void PBRTParser::parse_constant_texture(std::shared_ptr<DeclaredTexture> &dt) {
 
 	ygl::vec3f value{ 1, 1, 1 };
 	// read parameters
-	std::vector<std::shared_ptr<PBRTParameter>> params{};
+	ParameterList params(&directiveArena);
 	this->parse_parameters(params);
 
-	int i_v = find_param("value", params);
+	int i_v = find_param(ParamID::value, params);
 	if (i_v >= 0) {
-		if (params[i_v]->type == "float") {
-			auto v = params[i_v]->get_first_value<float>();
+		if (params[i_v].type == ParamType::Float) {
+			auto v = params[i_v].get_first_value<float>();
 			value.x = v;
 			value.y = v;
 			value.z = v;
 		}
 		else {
-			value = params[i_v]->get_first_value<ygl::vec3f>();
+			value = params[i_v].get_first_value<ygl::vec3f>();
 		}
 	}
 	dt->txt->ldr = make_constant_image(value);
@@ -1675,42 +1761,42 @@ void PBRTParser::parse_checkerboard_texture(std::shared_ptr<DeclaredTexture> &dt
 	ygl::vec4f tex1{ 0,0,0, 255 }, tex2{ 1,1,1, 255};
 
 	// read parameters
-	std::vector<std::shared_ptr<PBRTParameter>> params{};
+	ParameterList params(&directiveArena);
 	this->parse_parameters(params);
 
-	int i_u = find_param("uscale", params);
+	int i_u = find_param(ParamID::uscale, params);
 	if (i_u >= 0)
-		dt->uscale = params[i_u]->get_first_value<float>();
+		dt->uscale = params[i_u].get_first_value<float>();
 
-	int i_v = find_param("vscale", params);
+	int i_v = find_param(ParamID::vscale, params);
 	if (i_v >= 0)
-		dt->vscale = params[i_v]->get_first_value<float>();
+		dt->vscale = params[i_v].get_first_value<float>();
 
-	int i_txt1 = find_param("tex1", params);
+	int i_txt1 = find_param(ParamID::tex1, params);
 	if (i_txt1 >= 0) {
-		if (params[i_txt1]->type == "float") {
-			auto v = params[i_txt1]->get_first_value<float>();
+		if (params[i_txt1].type == ParamType::Float) {
+			auto v = params[i_txt1].get_first_value<float>();
 			tex1.x = v;
 			tex1.y = v;
 			tex1.z = v;
 		}
 		else {
-			auto v = params[i_txt1]->get_first_value<ygl::vec3f>();
+			auto v = params[i_txt1].get_first_value<ygl::vec3f>();
 			tex1.x = v.x;
 			tex1.y = v.y;
 			tex1.z = v.z;
 		}
 	}
-	int i_txt2 = find_param("tex2", params);
+	int i_txt2 = find_param(ParamID::tex2, params);
 	if (i_txt2 >= 0) {
-		if (params[i_txt2]->type == "float") {
-			auto v = params[i_txt2]->get_first_value<float>();
+		if (params[i_txt2].type == ParamType::Float) {
+			auto v = params[i_txt2].get_first_value<float>();
 			tex2.x = v;
 			tex2.y = v;
 			tex2.z = v;
 		}
 		else {
-			auto v = params[i_txt2]->get_first_value<ygl::vec3f>();
+			auto v = params[i_txt2].get_first_value<ygl::vec3f>();
 			tex2.x = v.x;
 			tex2.y = v.y;
 			tex2.z = v.z;
@@ -1735,45 +1821,45 @@ void PBRTParser::parse_scale_texture(std::shared_ptr<DeclaredTexture> &dt) {
 	ygl::texture *ytex2;
 
 	// read parameters
-	std::vector<std::shared_ptr<PBRTParameter>> params{};
+	ParameterList params(&directiveArena);
 	this->parse_parameters(params);
 	
 	// first get the first texture
-	int i_tex1 = find_param("tex1", params);
+	int i_tex1 = find_param(ParamID::tex1, params);
 	if (i_tex1 == -1)
 		throw_syntax_exception("Impossible to create scale texture, missing tex1.");
 
-	if (params[i_tex1]->type == "texture") {
-		ytex1 = texture_lookup(params[i_tex1]->get_first_value<std::string>(), false)->txt;
+	if (params[i_tex1].type == ParamType::Texture) {
+		ytex1 = texture_lookup(params[i_tex1].get_first_value<std::string>(), false)->txt;
 	}
 	else {
 		free_ytex1 = true;
 		ytex1 = new ygl::texture();
-		if (params[i_tex1]->type == "float")
-			ytex1->ldr = make_constant_image(params[i_tex1]->get_first_value<float>());
-		else if (params[i_tex1]->type == "rgb")
-			ytex1->ldr = make_constant_image(params[i_tex1]->get_first_value<ygl::vec3f>());
+		if (params[i_tex1].type == ParamType::Float)
+			ytex1->ldr = make_constant_image(params[i_tex1].get_first_value<float>());
+		else if (params[i_tex1].type == ParamType::RGB)
+			ytex1->ldr = make_constant_image(params[i_tex1].get_first_value<ygl::vec3f>());
 		else
 			throw_syntax_exception("Texture argument 'tex1' type not recognised in scale texture.");
 	}
 	// retrieve the textures
-	int i_tex2 = find_param("tex2", params);
+	int i_tex2 = find_param(ParamID::tex2, params);
 	if (i_tex2 == -1) {
 		if (free_ytex1)
 			delete ytex1;
 		throw_syntax_exception("Impossible to create scale texture, missing tex2.");
 	}
 		
-	if (params[i_tex2]->type == "texture") {
-		ytex2 = texture_lookup(params[i_tex2]->get_first_value<std::string>(), false)->txt;
+	if (params[i_tex2].type == ParamType::Texture) {
+		ytex2 = texture_lookup(params[i_tex2].get_first_value<std::string>(), false)->txt;
 	}
 	else {
 		ytex2 = new ygl::texture();
 		free_ytex2 = true;
-		if (params[i_tex2]->type == "float")
-			ytex2->ldr = make_constant_image(params[i_tex2]->get_first_value<float>());
-		else if (params[i_tex2]->type == "rgb")
-			ytex2->ldr = make_constant_image(params[i_tex2]->get_first_value<ygl::vec3f>());
+		if (params[i_tex2].type == ParamType::Float)
+			ytex2->ldr = make_constant_image(params[i_tex2].get_first_value<float>());
+		else if (params[i_tex2].type == ParamType::RGB)
+			ytex2->ldr = make_constant_image(params[i_tex2].get_first_value<ygl::vec3f>());
 		else {
 			if (free_ytex1)
 				delete ytex1;
@@ -1809,13 +1895,13 @@ void PBRTParser::parse_scale_texture(std::shared_ptr<DeclaredTexture> &dt) {
 	if (free_ytex2)
 		delete ytex2;
 
-	int i_u = find_param("uscale", params);
+	int i_u = find_param(ParamID::uscale, params);
 	if (i_u >= 0)
-		dt->uscale = params[i_u]->get_first_value<float>();
+		dt->uscale = params[i_u].get_first_value<float>();
 
-	int i_v = find_param("vscale", params);
+	int i_v = find_param(ParamID::vscale, params);
 	if (i_v >= 0)
-		dt->vscale = params[i_v]->get_first_value<float>();
+		dt->vscale = params[i_v].get_first_value<float>();
 }
 
 //
@@ -1833,16 +1919,14 @@ void PBRTParser::execute_Texture() {
 
 	if (this->current_token().type != LexemeType::STRING)
 		throw_syntax_exception("Expected texture name string.");
-	std::string textureName = this->current_token().value;
+	std::string textureName = this->current_token().str();
 	
-	auto it = gState.nameToTexture.find(textureName);
-	if (it != gState.nameToTexture.end())
-		gState.nameToTexture.erase(it);
+	nameToTexture.erase(textureName);
 
 	this->advance();
 	if (this->current_token().type != LexemeType::STRING)
 		throw_syntax_exception("Expected texture type string.");
-	std::string textureType = check_synonyms(this->current_token().value);
+	std::string textureType = std::string(check_synonyms(this->current_token().value));
 
 	if (textureType != "spectrum" && textureType != "rgb" && textureType != "float")
 		throw_syntax_exception("Unsupported texture base type: " + textureType);
@@ -1850,7 +1934,7 @@ void PBRTParser::execute_Texture() {
 	this->advance();
 	if (this->current_token().type != LexemeType::STRING)
 		throw_syntax_exception("Expected texture class string.");
-	std::string textureClass = this->current_token().value;
+	std::string textureClass = this->current_token().str();
 	this->advance();
 
 	if (textureClass == "imagemap") {
@@ -1869,7 +1953,7 @@ void PBRTParser::execute_Texture() {
 		throw_syntax_exception("Texture class not supported: " + textureClass);
 	}
 
-	gState.nameToTexture.insert(std::make_pair(textureName, dt));
+	nameToTexture.set(textureName, dt);
 }
 
 // ==========================================================================================
@@ -1897,33 +1981,9 @@ ygl::image4b make_constant_image(ygl::vec3f v) {
 
 //
 // find_param
-// search for a parameter by name in a vector of parsed parameters.
+// search for a parameter by id in a list of parsed parameters.
 // Returns the index of the searched parameter in the vector if found, -1 otherwise.
 //
-int find_param(std::string name, std::vector<std::shared_ptr<PBRTParameter>> &vec) {
-	int count = 0;
-	for (std::shared_ptr<PBRTParameter> &P : vec) {
-		if (P->name == name)
-			return count;
-		else
-			count++;
-	}
-	return -1;
-}
-
-//
-// my_compute_normals
-// because pbrt computes it differently
-// TODO: must be removed in future.
-//
-void my_compute_normals(const std::vector<ygl::vec3i>& triangles,
-	const std::vector<ygl::vec3f>& pos, std::vector<ygl::vec3f>& norm, bool weighted) {
-	norm.resize(pos.size());
-	for (auto& n : norm) n = ygl::zero3f;
-	for (auto& t : triangles) {
-		auto n = cross(pos[t.y] - pos[t.z], pos[t.x] - pos[t.z]); // it is different here
-		if (!weighted) n = normalize(n);
-		for (auto vid : t) norm[vid] += n;
-	}
-	for (auto& n : norm) n = normalize(n);
+int find_param(ParamID id, const ParameterList &vec) {
+	return vec.find(id);
 }
@@ -18,52 +18,170 @@
 #include <sstream>
 #include <exception>
 #include <unordered_map>
+#include <unordered_set>
+#include <array>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
 #define YGL_IMAGEIO 1
 #define YGL_OPENGL 0
 #include "../yocto/yocto_gl.h"
 #include "PBRTLexer.h"
+#include "ThreadPool.h"
+#include "IncludePrefetcher.h"
+#include "ShapeLoader.h"
 #include "PLYParser.h"
 #include "utils.h"
 #include "spectrum.h"
 
+//
+// ParamType
+// Types a parameter can be declared with. Spectrum and blackbody values are
+// converted to rgb while they are parsed, so they are never found in a parsed
+// parameter.
+//
+enum class ParamType : unsigned char {
+	String, Texture, Bool, Float, Integer, Point3, Normal3, RGB, Spectrum, Blackbody, Unknown
+};
+
+// names of the types, indexed by ParamType
+constexpr std::string_view paramTypeNames[(int)ParamType::Unknown] = {
+	"string", "texture", "bool", "float", "integer", "point3", "normal3", "rgb", "spectrum", "blackbody"
+};
+
+//
+// ParamID
+// Parameters known by the parser. Parameter names are interned when they are
+// declared, so that they can be looked up without comparing strings.
+//
+enum class ParamID : unsigned char {
+	Unknown, I, Kd, Kr, Ks, Kt, L, N, P, amount, bump, bumpmap, eta, filename, focaldistance,
+	fov, frameaspectratio, from, index, indices, k, lensradius, mapname, namedmaterial1,
+	namedmaterial2, p, radius, reflect, roughness, scale, splitdepth, st, tex1, tex2, transmit,
+	twosided, type, uscale, uv, value, vscale, width, xresolution, yresolution, Count
+};
+
+// names of the parameters, indexed by ParamID
+constexpr std::string_view paramNames[(int)ParamID::Count] = {
+	"", "I", "Kd", "Kr", "Ks", "Kt", "L", "N", "P", "amount", "bump", "bumpmap", "eta", "filename", "focaldistance",
+	"fov", "frameaspectratio", "from", "index", "indices", "k", "lensradius", "mapname", "namedmaterial1",
+	"namedmaterial2", "p", "radius", "reflect", "roughness", "scale", "splitdepth", "st", "tex1", "tex2", "transmit",
+	"twosided", "type", "uscale", "uv", "value", "vscale", "width", "xresolution", "yresolution"
+};
+
+constexpr KeywordTable<ParamID, (size_t)ParamID::Count, 1131380, 7> paramTable(paramNames);
+static_assert(paramTable.perfect, "Parameter names collide in the hash table, change the seed.");
+
 // A general directive parsed parameter has type, name and value.
+// Values are stored according to the type: strings and textures as views on the
+// source text, bools, floats, integers and vectors (point3, normal3, rgb) as
+// arrays of bool, float, int and ygl::vec3f. Up to 16 bytes of values (e.g. a
+// single rgb or string) are kept inline, longer arrays in the directive arena.
 class PBRTParameter {
     public:
-	bool used = false;
-	std::string type;
-    std::string name;
-	// value is actually a pointer to an array of values. Different
-	// parameters might have different types (hence void).
-	void *value = nullptr;
+	ParamType type = ParamType::Float;
+	std::string_view name;
+	// interned name (ParamID::Unknown for the parameters unknown to the parser)
+	ParamID id = ParamID::Unknown;
+	// number of values
+	size_t count = 0;
+
+	//
+	// allocate_values
+	// Makes room for n values of type T and returns the pointer to the first one.
+	//
+	template <typename T>
+	T *allocate_values(size_t n, Arena &arena) {
+		static_assert(std::is_trivially_destructible<T>::value, "Parameter values must be trivial.");
+		count = n;
+		if (n * sizeof(T) <= sizeof(local)) {
+			external = nullptr;
+			return (T *)local;
+		}
+		T *vals = arena.allocate_array<T>(n);
+		external = vals;
+		return vals;
+	}
+
+	template <typename T>
+	const T *values() const {
+		return (const T *)(external ? external : local);
+	}
 
 	//
 	// get_first_value
-	// get the first value of the parsed array of values
+	// get the first value of the parsed array of values. Floats and integers
+	// are converted to each other, a float is broadcast to a vector and a vector
+	// gives its first component. Any other mismatch gives a default value.
 	//
 	template <typename T>
-	T get_first_value() {
-		std::vector<T> *vals = (std::vector<T> *)value;
-		T v = vals->at(0);
-		return v;
+	T get_first_value() const {
+		switch (type) {
+		case ParamType::String:
+		case ParamType::Texture:
+			if constexpr (std::is_same<T, std::string>::value)
+				return std::string(values<std::string_view>()[0]);
+			else if constexpr (std::is_same<T, std::string_view>::value)
+				return values<std::string_view>()[0];
+			break;
+		case ParamType::Bool:
+			if constexpr (std::is_same<T, bool>::value)
+				return values<bool>()[0];
+			break;
+		case ParamType::Float:
+			if constexpr (std::is_arithmetic<T>::value)
+				return (T)values<float>()[0];
+			else if constexpr (std::is_same<T, ygl::vec3f>::value)
+				return ygl::vec3f{ values<float>()[0], values<float>()[0], values<float>()[0] };
+			break;
+		case ParamType::Integer:
+			if constexpr (std::is_arithmetic<T>::value)
+				return (T)values<int>()[0];
+			break;
+		default:
+			if constexpr (std::is_same<T, ygl::vec3f>::value)
+				return values<ygl::vec3f>()[0];
+			else if constexpr (std::is_arithmetic<T>::value)
+				return (T)values<ygl::vec3f>()[0].x;
+			break;
+		}
+		return T{};
 	};
 
-	~PBRTParameter(){
-		if(value == nullptr)
-			return;
-		if (type == "string" || type == "texture" || type == "bool") {
-			delete ((std::vector<std::string> *) value);
-		}
-		else if (type == "float") {
-			delete ((std::vector<float> *) value);
-		}
-		else if (type == "integer") {
-			delete ((std::vector<int> *) value);
-		}
-		else if (type == "point3" || type == "normal3"|| type == "rgb") {
-			delete ((std::vector<ygl::vec3f> *) value);
-		}
-		value = nullptr;	
+    private:
+	alignas(8) unsigned char local[16];
+	// values stored out of the parameter (nullptr if they are in local)
+	void *external = nullptr;
+};
+
+//
+// ParameterList
+// Parameters of a directive, in the order they were given. The list lives in
+// the directive arena, so it must not outlive the directive. Known parameters
+// are indexed by ParamID, so that they are found in constant time.
+//
+class ParameterList {
+    public:
+	ParameterList(Arena *arena) : params(ArenaAllocator<PBRTParameter>(arena)) {
+		std::fill(std::begin(index), std::end(index), -1);
 	};
+
+	void push_back(const PBRTParameter &par) {
+		// when a parameter is repeated, the first one wins
+		if (par.id != ParamID::Unknown && index[(int)par.id] < 0)
+			index[(int)par.id] = (int)params.size();
+		params.push_back(par);
+	};
+	void reserve(size_t n) { params.reserve(n); };
+	size_t size() const { return params.size(); };
+	const PBRTParameter &operator[](size_t i) const { return params[i]; };
+
+	// index of the parameter in the list, -1 if it was not given
+	int find(ParamID id) const { return index[(int)id]; };
+
+    private:
+	std::vector<PBRTParameter, ArenaAllocator<PBRTParameter>> params;
+	int index[(int)ParamID::Count];
 };
 
 // DeclaredTexture, DeclaredMaterial, DeclaredObject are structures
@@ -114,6 +232,78 @@ struct DeclaredObject {
 	};
 };
 
+//
+// ScopedMap
+// Map from names to values with nested scopes, like the symbol table of a
+// compiler. Changes made inside a scope are recorded in an undo log and reverted
+// when the scope is closed: opening a scope is O(1) and closing it costs as much
+// as the changes made inside it, regardless of the number of names in the map.
+//
+template <typename V>
+class ScopedMap {
+    public:
+	// returns nullptr if the name is not in the map
+	V *find(const std::string &name) {
+		auto it = map.find(name);
+		return it == map.end() ? nullptr : &it->second;
+	}
+
+	void set(const std::string &name, const V &value) {
+		auto it = map.find(name);
+		if (it == map.end()) {
+			log_change(name, false, V{});
+			map.emplace(name, value);
+		}
+		else {
+			log_change(name, true, it->second);
+			it->second = value;
+		}
+	}
+
+	void erase(const std::string &name) {
+		auto it = map.find(name);
+		if (it == map.end())
+			return;
+		log_change(name, true, it->second);
+		map.erase(it);
+	}
+
+	void push_scope() {
+		scopes.push_back(undoLog.size());
+	}
+
+	void pop_scope() {
+		size_t start = scopes.back();
+		scopes.pop_back();
+		// revert the changes in reverse order
+		while (undoLog.size() > start) {
+			Change &c = undoLog.back();
+			if (c.existed)
+				map[c.name] = std::move(c.old);
+			else
+				map.erase(c.name);
+			undoLog.pop_back();
+		}
+	}
+
+    private:
+	struct Change {
+		std::string name;
+		// false if the name was not in the map before the change
+		bool existed;
+		V old;
+	};
+	std::unordered_map<std::string, V> map{};
+	std::vector<Change> undoLog{};
+	// size of the undo log when each open scope was entered
+	std::vector<size_t> scopes{};
+
+	void log_change(const std::string &name, bool existed, const V &old) {
+		// changes made outside any scope are never reverted
+		if (!scopes.empty())
+			undoLog.push_back(Change{ name, existed, old });
+	}
+};
 
 struct GraphicsState {
 	// Current Transformation Matrix
@@ -131,10 +321,9 @@ struct GraphicsState {
 	// hack to apply uv scaling factor to shapes texture coordinates
 	float uscale = 1;
 	float vscale = 1;
-	// mappings to memorize data by name and use them in different times during parsing
-	// the following two belongs to the graphics 
-	std::unordered_map<std::string, std::shared_ptr<DeclaredTexture>> nameToTexture{};
-	std::unordered_map<std::string, std::shared_ptr<DeclaredMaterial>> nameToMaterial{};
+	// NOTE: named textures and materials belong to the graphics state too, but
+	// they are kept in PBRTParser as scoped maps, so that saving the state does
+	// not copy them.
 };
 
 
@@ -178,6 +367,28 @@ class PBRTParser {
 	// PRIVATE ATTRIBUTES
 	// stack of lexical analyzers (useful for Inlcude directives)
 	std::vector<std::shared_ptr<PBRTLexer>> lexers{};
+	// lexers of the included files that reached their end. They are kept alive
+	// until the next directive starts, since parsed parameters refer to their text.
+	std::vector<std::shared_ptr<PBRTLexer>> retiredLexers{};
+
+	// cache of the lexemes of the scene files (nullptr if not used). It is used
+	// by the workers, so it is declared before them.
+	std::unique_ptr<LexemeCache> lexemeCache{};
+
+	// workers reading the included files ahead of the parser
+	ThreadPool pool{};
+	IncludePrefetcher prefetcher{ pool };
+	ShapeLoader shapeLoader{ pool };
+
+	// memory for the parameters of the current directive, reset when the next
+	// directive starts.
+	Arena directiveArena{};
+
+	// scratch buffers where parameter values are parsed before being stored
+	std::vector<std::string_view> stringScratch{};
+	std::vector<float> floatScratch{};
+	std::vector<int> intScratch{};
+	std::vector<ygl::vec3f> vectorScratch{};
 	
 	// stack of CTMs
 	std::vector<ygl::mat4f> CTMStack{};
@@ -185,6 +396,11 @@ class PBRTParser {
 	// Stack of Graphic States
 	std::vector<GraphicsState> stateStack{};
 
+	// mappings to memorize data by name and use them in different times during parsing.
+	// Their scopes are opened and closed along with the graphics states.
+	ScopedMap<std::shared_ptr<DeclaredTexture>> nameToTexture{};
+	ScopedMap<std::shared_ptr<DeclaredMaterial>> nameToMaterial{};
+
 	// What follows are some variables that need to be shared among
 	// parsing statements
 	
@@ -205,6 +421,20 @@ class PBRTParser {
 	// one Object at time, using a single vector is fine.
 	std::vector<ygl::shape_group *> shapesInObject {};
 
+	// shapes to be completed once the directives have been parsed. A deque,
+	// since the jobs given to shapeLoader must not move.
+	std::deque<ShapeJob> shapeJobs{};
+	// if true, identical shapes outside objects share a single shape group
+	bool dedupShapes = false;
+	// vertex welding tolerance, no welding if negative
+	float weldEpsilon = -1;
+	// bytes removed from the vertex buffers by welding
+	size_t weldSavedBytes = 0;
+	// if true, the shapes are reordered for the vertex cache
+	bool optimizeVertexCache = false;
+	// name and result of each shape reordered, in scene order
+	std::vector<std::pair<std::string, VertexCacheStats>> vertexCacheReport{};
+
 	// Defines the current graphics properties active and to apply to the scene objects.
 	GraphicsState gState{ ygl::identity_mat4f, {}, nullptr};
 	// name to pair (list_of_shapes, CTM)
@@ -219,8 +449,12 @@ class PBRTParser {
 	unsigned int envCounter = 0;
 	enum CounterID {shape, shape_group, instance, material, texture, environment};
 
+	// number of directives dispatched so far (parsing statistics)
+	unsigned long directiveCounter = 0;
+
 	// The following mapping specifies the legal types for each possible parameter
-	std::unordered_map<std::string, std::vector<std::string>> parameterToType{};
+	// (an empty list means that any type is accepted)
+	std::array<std::vector<ParamType>, (size_t)ParamID::Count> parameterToType{};
 
 	// Resource folders
 	std::string textureSavePath = ".";
@@ -264,7 +498,11 @@ class PBRTParser {
 	void execute_TransformEnd();
 
 	void execute_Shape();
-	void parse_trianglemesh(ygl::shape *shp);
+	void parse_trianglemesh(ShapeJob &job);
+	// complete the shapes recorded during parsing
+	void build_shapes();
+	// merge the identical shapes built by build_shapes
+	void dedup_shapes();
 	// DEBUG method
 	void parse_cube(ygl::shape *shp);
 
@@ -278,15 +516,15 @@ class PBRTParser {
 	void execute_Material(bool makeNamedMaterial);
 	void execute_NamedMaterial();
 
-	void parse_material_matte(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params);
-	void parse_material_uber(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params);
-	void parse_material_plastic(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params);
-	void parse_material_metal(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params);
-	void parse_material_translucent(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params);
-	void parse_material_mirror(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params);
-	void parse_material_mix(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params);
-	void parse_material_glass(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params);
-	void parse_material_substrate(std::shared_ptr<DeclaredMaterial> &dmat, std::vector<std::shared_ptr<PBRTParameter>> &params);
+	void parse_material_matte(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params);
+	void parse_material_uber(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params);
+	void parse_material_plastic(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params);
+	void parse_material_metal(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params);
+	void parse_material_translucent(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params);
+	void parse_material_mirror(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params);
+	void parse_material_mix(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params);
+	void parse_material_glass(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params);
+	void parse_material_substrate(std::shared_ptr<DeclaredMaterial> &dmat, ParameterList &params);
 	
 	void load_texture(ygl::texture *txt, std::string &filename, bool flip = true);
 	ygl::texture* blend_textures(ygl::texture *txt1, ygl::texture *txt2, float amount);
@@ -296,26 +534,51 @@ class PBRTParser {
 	void parse_checkerboard_texture(std::shared_ptr<DeclaredTexture> &dt);
 	void execute_Texture();
 
+	// directive dispatch tables, indexed by Directive
+	typedef void (*DirectiveHandler)(PBRTParser *);
+	typedef std::array<DirectiveHandler, (size_t)Directive::Count> DirectiveHandlers;
+
 	void execute_preworld_directives();
 	void execute_world_directives();
 	void execute_world_directive();
+	void dispatch_directive(const DirectiveHandlers &handlers);
 
 	// Error and format compatibility handling methods.
 	void ignore_current_directive();
 
+	// "(file:line,column)" of the current token
+	inline std::string current_location() {
+		std::stringstream ss;
+		ss << "(" << this->current_file() << ":" << this->lexers.at(0)->get_line() << \
+			"," << this->lexers.at(0)->get_column() << ")";
+		return ss.str();
+	};
+
+	// "(file:line,column)" of a position of a file already read
+	inline std::string location_of(const std::string &file, size_t pos) {
+		int line = 0, column = 0;
+		std::stringstream ss;
+		ss << "(" << file;
+		if (PBRTLexer::find_line_column(file, pos, line, column))
+			ss << ":" << line << "," << column;
+		ss << ")";
+		return ss.str();
+	};
+
 	inline void throw_syntax_exception(std::string msg){
-        std::stringstream ss;
-        ss << "Syntax Error (" << this->current_file() << ":" << this->lexers.at(0)->get_line() <<\
-			"," << this->lexers.at(0)->get_column() << "): " << msg;
-		delete scn;
-        throw  PBRTException(ss.str());
+		throw_syntax_exception(msg, this->current_location());
     };
 
+	inline void throw_syntax_exception(std::string msg, const std::string &location) {
+		// shapes and included files of the scene may be being loaded
+		this->shapeLoader.cancel();
+		this->prefetcher.cancel();
+		delete scn;
+		throw PBRTException("Syntax Error " + location + ": " + msg);
+	};
+
 	inline void warning_message(std::string msg) {
-		std::stringstream ss;
-		ss << "WARNING: ("  << this->current_file() << ":" << this->lexers.at(0)->get_line() << \
-			"," << this->lexers.at(0)->get_column() << "): " << msg;
-		std::cout << ss.str() << "\n";
+		std::cout << "WARNING: " << this->current_location() << ": " << msg << "\n";
 	};
 
 	// get an id for shape, instance, ..
@@ -324,32 +587,60 @@ class PBRTParser {
 	void fill_parameter_to_type_mapping();
 
 	// check if the parameter par has been given a legal type
-	bool check_param_type(std::string par, std::string parsedType);
+	bool check_param_type(ParamID par, ParamType parsedType);
 	
 	// some types are synonyms, transform them to default.
-	std::string check_synonyms(std::string s);
+	std::string_view check_synonyms(std::string_view s);
 
 	// parse a single parameter type, name and associated value
-	std::shared_ptr<PBRTParameter>  parse_parameter();
+	PBRTParameter parse_parameter();
+
+	// parse type and name of a parameter (the value must be parsed next)
+	PBRTParameter parse_parameter_declaration();
+
+	// parse the value of a parameter, according to its type
+	void parse_parameter_value(PBRTParameter &par);
+
+	// copy the values parsed in a scratch buffer into the parameter
+	template <typename T>
+	void store_values(PBRTParameter &par, const std::vector<T> &vals) {
+		std::copy(vals.begin(), vals.end(), par.allocate_values<T>(vals.size(), directiveArena));
+	}
 	
 	// parse all the parameters of the current directive
-	void PBRTParser::parse_parameters(std::vector<std::shared_ptr<PBRTParameter>> &pars);
+	void parse_parameters(ParameterList &pars);
 
 	//
 	// parse_value
-	// Parse an array of values (or a single value).
+	// Parse an array of values (or a single value) and append it to vals.
+	// Elements of type T are made of N consecutive values (e.g. N = 3 for ygl::vec3f),
+	// so that vectors are written straight in their final buffer. The array is counted
+	// before being parsed, hence vals is resized only once.
+	// Returns the number of values parsed: if it is not a multiple of N, the last
+	// incomplete element is dropped and it is up to the caller to signal the error.
 	//
-	template <typename T, int LT, typename _CONVERTER>
-	void parse_value(std::vector<T> *vals, _CONVERTER converter) {
+	template <typename T, int LT, int N = 1, typename _CONVERTER>
+	int parse_value(std::vector<T> *vals, _CONVERTER converter) {
 
 		bool isArray = false;
 		if (this->current_token().value == "[") {
+			vals->reserve(vals->size() + this->lexers.at(0)->count_array_values() / N);
 			this->advance();
 			isArray = true;
 		}
 
+		int count = 0;
+		T element{};
 		while (this->current_token().type == LT) {
-			vals->push_back(converter(this->current_token().value));
+			if constexpr (N == 1) {
+				vals->push_back(converter(this->current_token()));
+			}
+			else {
+				element[count % N] = converter(this->current_token());
+				if (count % N == N - 1)
+					vals->push_back(element);
+			}
+			count++;
 			this->advance();
 			if (!isArray)
 				break;
@@ -360,49 +651,78 @@ class PBRTParser {
 			else
 				throw_syntax_exception("Expected closing ']'.");
 		}
-		if (vals->size() == 0)
+		if (count == 0)
 			throw_syntax_exception("The array parsed is empty.");
+		return count;
 	};
 
 	//
 	// set_k_property
 	// Convenience function to set kd, ks, kt, kr from parsed parameter
 	//
-	void set_k_property(std::shared_ptr<PBRTParameter> &par, ygl::vec3f &k, ygl::texture **txt);
+	void set_k_property(const PBRTParameter &par, ygl::vec3f &k, ygl::texture **txt);
 
 	//
 	// texture lookup.
 	//
-	std::shared_ptr<DeclaredTexture> texture_lookup(std::string &name, bool markAsAddedInScene) {
-		auto it = gState.nameToTexture.find(name);
-		if (it == gState.nameToTexture.end())
+	std::shared_ptr<DeclaredTexture> texture_lookup(const std::string &name, bool markAsAddedInScene) {
+		auto dt = nameToTexture.find(name);
+		if (!dt)
 			throw_syntax_exception("Texture '" + name + "' was not found among declared textures.");
-		if (markAsAddedInScene && it->second->addedInScene == false) {
-			scn->textures.push_back(it->second->txt);
-			it->second->addedInScene = true;
+		if (markAsAddedInScene && (*dt)->addedInScene == false) {
+			scn->textures.push_back((*dt)->txt);
+			(*dt)->addedInScene = true;
 		}
-		return it->second;
+		return *dt;
 	}
 
 	//
 	// material lookup.
 	//
-	std::shared_ptr<DeclaredMaterial> material_lookup(std::string &name, bool markAsAddedInScene) {
-		auto it = gState.nameToMaterial.find(name);
-		if (it == gState.nameToMaterial.end())
+	std::shared_ptr<DeclaredMaterial> material_lookup(const std::string &name, bool markAsAddedInScene) {
+		auto dmat = nameToMaterial.find(name);
+		if (!dmat)
 			throw_syntax_exception("Named material '" + name + "' was not found among declared named materials.");
-		if (markAsAddedInScene && it->second->addedInScene == false) {
-			scn->materials.push_back(it->second->mat);
-			it->second->addedInScene = true;
+		if (markAsAddedInScene && (*dmat)->addedInScene == false) {
+			scn->materials.push_back((*dmat)->mat);
+			(*dmat)->addedInScene = true;
 		}
-		return it->second;
+		return *dmat;
 	}
 
 	public:
-	// Build a parser for the scene pointed by "filename"
-	PBRTParser(std::string filename);
+	// Build a parser for the scene pointed by "filename". If cacheDirectory is
+	// given, the lexemes of the scene files are cached there (see LexemeCache).
+	PBRTParser(std::string filename, std::string cacheDirectory = "");
+	// limits of the background loading of ply files, see ShapeLoader
+	void set_ply_load_limits(size_t maxLoads, size_t maxBytes) {
+		this->shapeLoader.set_limits(maxLoads, maxBytes);
+	};
+	// merge the shapes with the same content and material (see dedup_shapes)
+	void set_shape_dedup(bool enabled) {
+		this->dedupShapes = enabled;
+	};
+	// weld the vertices of the shapes closer than epsilon and drop the unused
+	// ones (see weld_vertices); a negative epsilon disables welding
+	void set_vertex_welding(float epsilon) {
+		this->weldEpsilon = epsilon;
+	};
+	// reorder triangles and vertices of the shapes for the vertex cache (see
+	// optimize_vertex_cache)
+	void set_vertex_cache_optimization(bool enabled) {
+		this->optimizeVertexCache = enabled;
+	};
+	~PBRTParser();
 	// start the parsing.
     ygl::scene *parse();
+	// number of directives executed or ignored by the parser.
+	unsigned long get_directive_count() const { return directiveCounter; }
+	// bytes removed from the vertex buffers by welding.
+	size_t get_weld_saved_bytes() const { return weldSavedBytes; }
+	// shapes reordered for the vertex cache, with their results.
+	const std::vector<std::pair<std::string, VertexCacheStats>> &get_vertex_cache_report() const {
+		return vertexCacheReport;
+	}
 
 };
 
@@ -412,10 +732,10 @@ class PBRTParser {
 
 //
 // find_param
-// search for a parameter by name in a vector of parsed parameters.
+// search for a parameter by id in a list of parsed parameters.
 // Returns the index of the searched parameter in the vector if found, -1 otherwise.
 //
-int find_param(std::string name, std::vector<std::shared_ptr<PBRTParameter>> &vec);
+int find_param(ParamID id, const ParameterList &vec);
 
 //
 // make_constant_image
@@ -438,12 +758,4 @@ ygl::image<T> flip_image(ygl::image<T> in) {
 	}
 	return nI;
 }
-
-//
-// my_compute_normals
-// because pbrt computes it differently
-// TODO: must be removed in future.
-//
-void my_compute_normals(const std::vector<ygl::vec3i>& triangles,
-	const std::vector<ygl::vec3f>& pos, std::vector<ygl::vec3f>& norm, bool weighted);
 #endif
@@ -1,238 +1,762 @@
 #include "PLYParser.h"
+#include <cstring>
+#include <charconv>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+//
+// PlyType
+// Scalar types of the properties in a PLY file.
+//
+enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Unknown };
+
+static PlyType parse_ply_type(const std::string &name) {
+	if (name == "char" || name == "int8") return PlyType::Int8;
+	if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+	if (name == "short" || name == "int16") return PlyType::Int16;
+	if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+	if (name == "int" || name == "int32") return PlyType::Int32;
+	if (name == "uint" || name == "uint32") return PlyType::UInt32;
+	if (name == "float" || name == "float32") return PlyType::Float32;
+	if (name == "double" || name == "float64") return PlyType::Float64;
+	return PlyType::Unknown;
+}
+
+static size_t ply_type_size(PlyType type) {
+	static const size_t sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8, 0 };
+	return sizes[(int)type];
+}
+
+static bool is_integer_type(PlyType type) {
+	return type != PlyType::Float32 && type != PlyType::Float64 && type != PlyType::Unknown;
+}
+
+static bool host_is_big_endian() {
+	const uint16_t one = 1;
+	unsigned char first;
+	std::memcpy(&first, &one, 1);
+	return first == 0;
+}
+
+//
+// swap_bytes
+// Reverse the byte order of a value. Floating point values are swapped as
+// unsigned integers of the same size.
+//
+static inline uint8_t swap_bytes(uint8_t v) { return v; }
+static inline uint16_t swap_bytes(uint16_t v) { return (uint16_t)((v << 8) | (v >> 8)); }
+static inline uint32_t swap_bytes(uint32_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_bswap32(v);
+#else
+	return ((v & 0xff) << 24) | ((v & 0xff00) << 8) | ((v >> 8) & 0xff00) | (v >> 24);
+#endif
+}
+static inline uint64_t swap_bytes(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_bswap64(v);
+#else
+	return ((uint64_t)swap_bytes((uint32_t)v) << 32) | swap_bytes((uint32_t)(v >> 32));
+#endif
+}
+
+// unsigned integer with the same size of T
+template <size_t N> struct PlyBits {};
+template <> struct PlyBits<1> { typedef uint8_t type; };
+template <> struct PlyBits<2> { typedef uint16_t type; };
+template <> struct PlyBits<4> { typedef uint32_t type; };
+template <> struct PlyBits<8> { typedef uint64_t type; };
+
+//
+// convert_values
+// Kernel reading count values of type Src, srcStride bytes apart, and writing
+// them as Dst, dstStride elements apart. Types and byte order are known at
+// compile time, so the loop has no branches and is vectorized by the compiler
+// when the strides allow it (e.g. the packed x y z of a vertex list).
+//
+template <typename Src, bool Swap, typename Dst>
+static void convert_values(const char *src, size_t srcStride, size_t count, Dst *dst, size_t dstStride) {
+	typedef typename PlyBits<sizeof(Src)>::type Bits;
+	for (size_t i = 0; i < count; i++) {
+		Bits bits;
+		std::memcpy(&bits, src + i * srcStride, sizeof(Src));
+		if (Swap)
+			bits = swap_bytes(bits);
+		Src v;
+		std::memcpy(&v, &bits, sizeof(Src));
+		dst[i * dstStride] = (Dst)v;
+	}
+}
+
+// Chooses the kernel for the type of the values in the file.
+template <bool Swap, typename Dst>
+static void convert_values(PlyType type, const char *src, size_t srcStride, size_t count, Dst *dst, size_t dstStride) {
+	switch (type) {
+	case PlyType::Int8: convert_values<int8_t, Swap>(src, srcStride, count, dst, dstStride); break;
+	case PlyType::UInt8: convert_values<uint8_t, Swap>(src, srcStride, count, dst, dstStride); break;
+	case PlyType::Int16: convert_values<int16_t, Swap>(src, srcStride, count, dst, dstStride); break;
+	case PlyType::UInt16: convert_values<uint16_t, Swap>(src, srcStride, count, dst, dstStride); break;
+	case PlyType::Int32: convert_values<int32_t, Swap>(src, srcStride, count, dst, dstStride); break;
+	case PlyType::UInt32: convert_values<uint32_t, Swap>(src, srcStride, count, dst, dstStride); break;
+	case PlyType::Float32: convert_values<float, Swap>(src, srcStride, count, dst, dstStride); break;
+	case PlyType::Float64: convert_values<double, Swap>(src, srcStride, count, dst, dstStride); break;
+	default: break;
+	}
+}
+
+template <typename Dst>
+static void convert_values(PlyType type, bool swap, const char *src, size_t srcStride, size_t count,
+	Dst *dst, size_t dstStride) {
+	if (swap)
+		convert_values<true>(type, src, srcStride, count, dst, dstStride);
+	else
+		convert_values<false>(type, src, srcStride, count, dst, dstStride);
+}
+
+//
+// PlyProperty
+//
+struct PlyProperty {
+	std::string name;
+	PlyType type;
+};
+
+//
+// PlyHeader
+// What is needed of the header of a PLY file to read its data.
+//
+struct PlyHeader {
+	bool ascii = false;
+	bool bigEndian = false;
+	// elements in the order they appear in the file (only vertex and face)
+	std::vector<std::string> elements;
+	int n_vertices = 0;
+	std::vector<PlyProperty> vertexProps;
+	int n_faces = 0;
+	// types of the vertex count and of the indices of the face lists
+	PlyType faceCountType = PlyType::UInt8;
+	PlyType faceIndexType = PlyType::Int32;
+	// offset of the first byte after the header
+	size_t dataStart = 0;
+};
+
+//
+// PlyVertexLayout
+// Byte offset (-1 when the property is missing) and type of the vertex
+// properties inside a vertex of a binary file, computed once from the header.
+//
+struct PlyVertexLayout {
+	enum Property { X, Y, Z, NX, NY, NZ, U, V, Count };
+	size_t stride = 0;
+	int offset[Count] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+	PlyType type[Count] = {};
+	// type shared by all the properties, Unknown if they differ
+	PlyType commonType = PlyType::Unknown;
+	// property (X, Y, ...) of every value, in the order of the file
+	std::vector<int> slots;
+};
+
+//
+// compile_vertex_layout
+// Returns false if some property is not known.
+//
+static bool compile_vertex_layout(const std::vector<PlyProperty> &props, PlyVertexLayout &layout,
+	std::ostream &log) {
+	static const char *names[] = { "x", "y", "z", "nx", "ny", "nz", "u", "v" };
+	for (size_t i = 0; i < props.size(); i++) {
+		auto &prop = props[i];
+		int p = 0;
+		while (p < PlyVertexLayout::Count && prop.name != names[p])
+			p++;
+		if (p == PlyVertexLayout::Count) {
+			log << "Value " << prop.name << " is not a recognized property of vertex.\n";
+			return false;
+		}
+		layout.offset[p] = (int)layout.stride;
+		layout.type[p] = prop.type;
+		layout.slots.push_back(p);
+		if (i == 0)
+			layout.commonType = prop.type;
+		else if (layout.commonType != prop.type)
+			layout.commonType = PlyType::Unknown;
+		layout.stride += ply_type_size(prop.type);
+	}
+	return true;
+}
+
+//
+// decode_vertex_properties
+// Decodes the properties [first, first + n) of all the vertices into the
+// components of a shape buffer. Missing properties are set to 0.
+//
+template <typename V>
+static void decode_vertex_properties(const char *block, size_t n_vertices, const PlyVertexLayout &layout,
+	int first, int n, bool swap, std::vector<V> &out) {
+	out.resize(n_vertices);
+	size_t dstStride = sizeof(V) / sizeof(float);
+	for (int c = 0; c < n; c++) {
+		float *dst = &out[0].x + c;
+		int p = first + c;
+		if (layout.offset[p] < 0) {
+			for (size_t i = 0; i < n_vertices; i++)
+				dst[i * dstStride] = 0;
+		}
+		else {
+			convert_values(layout.type[p], swap, block + layout.offset[p], layout.stride, n_vertices, dst, dstStride);
+		}
+	}
+}
+
+//
+// add_polygon
+// Adds a face of n vertices to the shape: triangles and quads are kept as
+// they are, larger polygons are split in a fan of triangles around the first
+// vertex. index(i) gives the i-th vertex of the face.
+//
+template <typename IndexFn>
+static void add_polygon(ygl::shape *shp, int n, IndexFn index) {
+	if (n == 3) {
+		shp->triangles.push_back({ index(0), index(1), index(2) });
+	}
+	else if (n == 4) {
+		shp->quads.push_back({ index(0), index(1), index(2), index(3) });
+	}
+	else {
+		int first = index(0);
+		int prev = index(1);
+		for (int i = 2; i < n; i++) {
+			int cur = index(i);
+			shp->triangles.push_back({ first, prev, cur });
+			prev = cur;
+		}
+	}
+}
+
+//
+// merge_faces
+// A shape holds either triangles or quads: when a file has both, the triangles
+// become degenerate quads (the last index repeated), as yocto expects.
+//
+static void merge_faces(ygl::shape *shp) {
+	if (shp->quads.empty() || shp->triangles.empty())
+		return;
+	shp->quads.reserve(shp->quads.size() + shp->triangles.size());
+	for (auto &t : shp->triangles)
+		shp->quads.push_back({ t.x, t.y, t.z, t.z });
+	shp->triangles.clear();
+	shp->triangles.shrink_to_fit();
+}
+
+//
+// decode_polygons
+// Decodes a face block whose faces do not all have three vertices, one face
+// at a time. Returns the offset of the first byte after the block, or 0 if
+// the file ends before it.
+//
+static size_t decode_polygons(const char *data, size_t size, size_t pos, size_t n_faces, const PlyHeader &header,
+	bool swap, ygl::shape *shp, std::ostream &log, const std::string &errMsgStart) {
+	size_t countSize = ply_type_size(header.faceCountType);
+	size_t indexSize = ply_type_size(header.faceIndexType);
+	shp->triangles.clear();
+	shp->triangles.reserve(n_faces);
+	for (size_t f = 0; f < n_faces; f++) {
+		if (size - pos < countSize) {
+			log << errMsgStart << "Unexpected end of file reading faces.\n";
+			return 0;
+		}
+		int n;
+		convert_values(header.faceCountType, swap, data + pos, 0, 1, &n, 1);
+		pos += countSize;
+		if (n < 3) {
+			log << errMsgStart << "There must be at least three vertices per face. Got " << n << " instead.\n";
+			return 0;
+		}
+		if ((size - pos) / indexSize < (size_t)n) {
+			log << errMsgStart << "Unexpected end of file reading faces.\n";
+			return 0;
+		}
+		const char *indices = data + pos;
+		add_polygon(shp, n, [&](int i) {
+			int v;
+			convert_values(header.faceIndexType, swap, indices + i * indexSize, 0, 1, &v, 1);
+			return v;
+		});
+		pos += n * indexSize;
+	}
+	return pos;
+}
+
+//
+// parse_ply_binary
+// Decodes the elements of a binary file. The file is mapped in memory (see
+// parse_ply) and every element block is decoded straight into the shape buffers, one property at a
+// time, by kernels specialized for the type and the byte order of the file.
+//
+static bool parse_ply_binary(const std::string &filename, const InputBuffer &input, const PlyHeader &header,
+	ygl::shape *shp, std::ostream &log) {
+	auto errMsgStart = "[File: " + filename + "]: ";
+	const char *data = input.data();
+	size_t size = input.size();
+	size_t pos = std::min(header.dataStart, size);
+	bool swap = header.bigEndian != host_is_big_endian();
+	size_t n_vertices = header.n_vertices > 0 ? header.n_vertices : 0;
+	size_t n_faces = header.n_faces > 0 ? header.n_faces : 0;
+
+	PlyVertexLayout layout;
+	if (n_vertices > 0 && !compile_vertex_layout(header.vertexProps, layout, log))
+		return false;
+
+	for (auto &elem : header.elements) {
+		if (elem == "vertex") {
+			if (n_vertices == 0)
+				continue;
+			if (layout.offset[PlyVertexLayout::X] < 0) {
+				log << errMsgStart << "No vertex positions\n";
+				return false;
+			}
+			if (size < pos || (size - pos) / layout.stride < n_vertices) {
+				log << errMsgStart << "Unexpected end of file reading vertices.\n";
+				return false;
+			}
+			const char *block = data + pos;
+			size_t typeSize = ply_type_size(layout.commonType);
+			if (layout.commonType != PlyType::Unknown && layout.stride == 3 * typeSize &&
+				layout.offset[PlyVertexLayout::X] == 0 && layout.offset[PlyVertexLayout::Y] == (int)typeSize &&
+				layout.offset[PlyVertexLayout::Z] == 2 * (int)typeSize) {
+				// positions only: a single contiguous run of values
+				shp->pos.resize(n_vertices);
+				if (layout.commonType == PlyType::Float32 && !swap)
+					std::memcpy(shp->pos.data(), block, n_vertices * layout.stride);
+				else
+					convert_values(layout.commonType, swap, block, typeSize, 3 * n_vertices, &shp->pos[0].x, 1);
+			}
+			else {
+				decode_vertex_properties(block, n_vertices, layout, PlyVertexLayout::X, 3, swap, shp->pos);
+			}
+			if (layout.offset[PlyVertexLayout::NX] >= 0)
+				decode_vertex_properties(block, n_vertices, layout, PlyVertexLayout::NX, 3, swap, shp->norm);
+			if (layout.offset[PlyVertexLayout::U] >= 0)
+				decode_vertex_properties(block, n_vertices, layout, PlyVertexLayout::U, 2, swap, shp->texcoord);
+			pos += n_vertices * layout.stride;
+		}
+		else if (elem == "face") {
+			if (n_faces == 0)
+				continue;
+			// first assume that every face is a count followed by three indices,
+			// and check the counts at those offsets
+			size_t countSize = ply_type_size(header.faceCountType);
+			size_t indexSize = ply_type_size(header.faceIndexType);
+			size_t faceStride = countSize + 3 * indexSize;
+			const char *block = data + pos;
+			bool onlyTriangles = size >= pos && (size - pos) / faceStride >= n_faces;
+			if (onlyTriangles) {
+				shp->triangles.resize(n_faces);
+				// the counts are converted using the indices buffer as scratch
+				int *counts = &shp->triangles[0].x;
+				convert_values(header.faceCountType, swap, block, faceStride, n_faces, counts, 3);
+				for (size_t f = 0; f < n_faces && onlyTriangles; f++)
+					onlyTriangles = counts[3 * f] == 3;
+			}
+			if (onlyTriangles) {
+				for (int c = 0; c < 3; c++)
+					convert_values(header.faceIndexType, swap, block + countSize + c * indexSize, faceStride, n_faces,
+						&shp->triangles[0].x + c, 3);
+				pos += n_faces * faceStride;
+			}
+			else {
+				pos = decode_polygons(data, size, pos, n_faces, header, swap, shp, log, errMsgStart);
+				if (pos == 0) {
+					shp->triangles.clear();
+					shp->quads.clear();
+					return false;
+				}
+				merge_faces(shp);
+			}
+		}
+		else {
+			log << errMsgStart << "Element '" << elem << "' not recognized.\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+//
+// parse_ply_value
+// Reads a number of an ascii file starting from p, after the blanks. Values
+// cannot cross the end of the line. Returns nullptr if there is no number.
+//
+template <typename T>
+static const char *parse_ply_value(const char *p, const char *end, T &value) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+	// from_chars does not accept an explicit plus
+	if (p < end && *p == '+')
+		p++;
+	auto res = std::from_chars(p, end, value);
+	if (res.ec == std::errc::result_out_of_range) {
+		// the number is valid: take the zero, infinity or limit that atof and
+		// atoi would give
+		std::string number(p, res.ptr);
+		if constexpr (std::is_same<T, float>::value)
+			value = std::strtof(number.c_str(), nullptr);
+		else if constexpr (std::is_floating_point<T>::value)
+			value = (T)std::strtod(number.c_str(), nullptr);
+		else
+			value = (T)std::clamp<long long>(std::strtoll(number.c_str(), nullptr, 10),
+				std::numeric_limits<T>::min(), std::numeric_limits<T>::max());
+	}
+	else if (res.ec != std::errc() || res.ptr == p)
+		return nullptr;
+	return res.ptr;
+}
+
+static const char *next_line(const char *p, const char *end) {
+	const char *newline = (const char *)std::memchr(p, '\n', end - p);
+	return newline ? newline + 1 : end;
+}
+
+// lines of an ascii element block handed out as a unit to the threads
+static const size_t plyLinesPerGranule = 4096;
+// the decoding of a block is split across threads only for blocks bigger than
+// this many bytes per thread
+static const size_t plyBytesPerThread = (size_t)4 << 20;
+
+//
+// PlyAsciiBlock
+// The lines of an ascii element block, split in chunks that are decoded by
+// different threads. Every chunk starts at the beginning of a line.
+//
+struct PlyAsciiBlock {
+	// first byte of every granule of lines
+	std::vector<const char *> granules;
+	size_t n_lines = 0;
+	const char *end = nullptr;
+	size_t n_chunks = 1;
+
+	const char *chunk_begin(size_t c) const { return this->granules[this->first_granule(c)]; };
+	size_t first_line(size_t c) const { return this->first_granule(c) * plyLinesPerGranule; };
+	size_t last_line(size_t c) const { return std::min(this->first_granule(c + 1) * plyLinesPerGranule, this->n_lines); };
+	size_t first_granule(size_t c) const { return c * this->granules.size() / this->n_chunks; };
+};
+
+//
+// split_ascii_block
+// Finds the end of a block of n lines starting at p, recording where the line
+// granules start, and decides in how many chunks the block is decoded (one per
+// thread of the pool at most, a single one without a pool).
+// Returns false if the file ends before.
+//
+static bool split_ascii_block(const char *p, const char *end, size_t n_lines, ThreadPool *pool, PlyAsciiBlock &block) {
+	const char *begin = p;
+	block.n_lines = n_lines;
+	block.granules.reserve(n_lines / plyLinesPerGranule + 1);
+	for (size_t i = 0; i < n_lines; i++) {
+		if (p >= end)
+			return false;
+		if (i % plyLinesPerGranule == 0)
+			block.granules.push_back(p);
+		p = next_line(p, end);
+	}
+	block.end = p;
+	size_t threads = pool ? std::max(1u, pool->size()) : 1;
+	size_t bySize = std::max<size_t>(1, (size_t)(p - begin) / plyBytesPerThread);
+	block.n_chunks = std::min({ threads, bySize, std::max<size_t>(1, block.granules.size()) });
+	return true;
+}
+
+//
+// run_chunks
+// Calls body(c) for every chunk of the block, on the pool. The loaders already
+// run on the pool: the calling thread takes part in the loop, so the threads
+// in use never exceed the workers.
+//
+template <typename F>
+static void run_chunks(const PlyAsciiBlock &block, ThreadPool *pool, F body) {
+	if (!pool || block.n_chunks == 1) {
+		for (size_t c = 0; c < block.n_chunks; c++)
+			body(c);
+		return;
+	}
+	pool->parallel_for(block.n_chunks, body);
+}
+
+//
+// PlyChunkError
+// First error met by a chunk, reported after all the chunks are done so that
+// the first error of the file is the one reported.
+//
+struct PlyChunkError {
+	bool failed = false;
+	std::string message;
+};
+
+static bool report_chunk_errors(const std::vector<PlyChunkError> &errors, std::ostream &log,
+	const std::string &errMsgStart) {
+	for (auto &e : errors) {
+		if (e.failed) {
+			log << errMsgStart << e.message;
+			return false;
+		}
+	}
+	return true;
+}
+
+//
+// parse_ply_ascii
+// Decodes the elements of an ascii file. The file is mapped in memory and its
+// numbers are read in place; the values of a vertex line are stored according
+// to the slots compiled from the header. Big element blocks are split at line
+// boundaries and decoded by several threads.
+//
+static bool parse_ply_ascii(const std::string &filename, const InputBuffer &input, const PlyHeader &header,
+	ygl::shape *shp, std::ostream &log, ThreadPool *pool) {
+	auto errMsgStart = "[File: " + filename + "]: ";
+	const char *end = input.data() + input.size();
+	const char *p = input.data() + std::min(header.dataStart, input.size());
+	size_t n_vertices = header.n_vertices > 0 ? header.n_vertices : 0;
+	size_t n_faces = header.n_faces > 0 ? header.n_faces : 0;
+
+	PlyVertexLayout layout;
+	if (n_vertices > 0 && !compile_vertex_layout(header.vertexProps, layout, log))
+		return false;
+
+	for (auto &elem : header.elements) {
+		if (elem == "vertex") {
+			if (n_vertices == 0)
+				continue;
+			if (layout.offset[PlyVertexLayout::X] < 0) {
+				log << errMsgStart << "No vertex positions\n";
+				return false;
+			}
+			PlyAsciiBlock block;
+			if (!split_ascii_block(p, end, n_vertices, pool, block)) {
+				log << errMsgStart << "Unexpected end of file reading vertices.\n";
+				return false;
+			}
+			bool hasNorm = layout.offset[PlyVertexLayout::NX] >= 0;
+			bool hasUV = layout.offset[PlyVertexLayout::U] >= 0;
+			shp->pos.resize(n_vertices);
+			if (hasNorm)
+				shp->norm.resize(n_vertices);
+			if (hasUV)
+				shp->texcoord.resize(n_vertices);
+
+			std::vector<PlyChunkError> errors(block.n_chunks);
+			run_chunks(block, pool, [&](size_t c) {
+				const char *q = block.chunk_begin(c);
+				for (size_t v = block.first_line(c); v < block.last_line(c); v++) {
+					float values[PlyVertexLayout::Count] = {};
+					for (int slot : layout.slots) {
+						q = parse_ply_value(q, end, values[slot]);
+						if (!q) {
+							errors[c].failed = true;
+							errors[c].message = "Expected " + std::to_string(layout.slots.size()) +
+								" values for vertex " + std::to_string(v) + ".\n";
+							return;
+						}
+					}
+					shp->pos[v] = { values[PlyVertexLayout::X], values[PlyVertexLayout::Y], values[PlyVertexLayout::Z] };
+					if (hasNorm)
+						shp->norm[v] = { values[PlyVertexLayout::NX], values[PlyVertexLayout::NY], values[PlyVertexLayout::NZ] };
+					if (hasUV)
+						shp->texcoord[v] = { values[PlyVertexLayout::U], values[PlyVertexLayout::V] };
+					q = next_line(q, end);
+				}
+			});
+			if (!report_chunk_errors(errors, log, errMsgStart))
+				return false;
+			p = block.end;
+		}
+		else if (elem == "face") {
+			if (n_faces == 0)
+				continue;
+			PlyAsciiBlock block;
+			if (!split_ascii_block(p, end, n_faces, pool, block)) {
+				log << errMsgStart << "Unexpected end of file reading faces.\n";
+				return false;
+			}
+			// every chunk collects its faces in its own shape, they are joined
+			// in the order of the file at the end
+			std::vector<ygl::shape> parts(block.n_chunks);
+			std::vector<PlyChunkError> errors(block.n_chunks);
+			run_chunks(block, pool, [&](size_t c) {
+				ygl::shape *part = block.n_chunks == 1 ? shp : &parts[c];
+				part->triangles.reserve(block.last_line(c) - block.first_line(c));
+				std::vector<int> indices;
+				const char *q = block.chunk_begin(c);
+				for (size_t f = block.first_line(c); f < block.last_line(c); f++) {
+					int n = 0;
+					q = parse_ply_value(q, end, n);
+					if (q && n < 3) {
+						errors[c].failed = true;
+						errors[c].message = "There must be at least three vertices per face. Got " +
+							std::to_string(n) + " instead.\n";
+						return;
+					}
+					// a line cannot hold more indices than bytes
+					if (q && (size_t)n > (size_t)(end - q))
+						q = nullptr;
+					indices.resize(q ? n : 0);
+					for (int i = 0; q && i < n; i++)
+						q = parse_ply_value(q, end, indices[i]);
+					if (!q) {
+						errors[c].failed = true;
+						errors[c].message = "Expected " + (n > 0 ? std::to_string(n) + " " : "") +
+							"vertex indexes in face " + std::to_string(f) + ".\n";
+						return;
+					}
+					add_polygon(part, n, [&](int i) { return indices[i]; });
+					q = next_line(q, end);
+				}
+			});
+			if (!report_chunk_errors(errors, log, errMsgStart)) {
+				shp->triangles.clear();
+				shp->quads.clear();
+				return false;
+			}
+			if (block.n_chunks > 1) {
+				size_t n_triangles = 0, n_quads = 0;
+				for (auto &part : parts) {
+					n_triangles += part.triangles.size();
+					n_quads += part.quads.size();
+				}
+				shp->triangles.reserve(n_triangles);
+				shp->quads.reserve(n_quads);
+				for (auto &part : parts) {
+					shp->triangles.insert(shp->triangles.end(), part.triangles.begin(), part.triangles.end());
+					shp->quads.insert(shp->quads.end(), part.quads.begin(), part.quads.end());
+				}
+			}
+			merge_faces(shp);
+			p = block.end;
+		}
+		else {
+			log << errMsgStart << "Element '" << elem << "' not recognized.\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+//
+// read_header_line
+// Reads the line starting at pos (without the newline) and moves pos to the
+// next one. Returns false, with an empty line, at the end of the buffer.
+//
+static bool read_header_line(const InputBuffer &input, size_t &pos, std::string &line) {
+	if (pos >= input.size()) {
+		line.clear();
+		return false;
+	}
+	const char *begin = input.data() + pos;
+	const char *end = input.data() + input.size();
+	const char *newline = (const char *)std::memchr(begin, '\n', end - begin);
+	const char *last = newline ? newline : end;
+	line.assign(begin, last);
+	pos = newline ? (size_t)(newline + 1 - input.data()) : input.size();
+	return true;
+}
+
 //
 // parse_ply
 // Parse a PLY file format and fills a shape object (shp must be already created).
 // Note: works for binary and ascii, but only when faces and vertex elements are present.
 // TODO: a less ugly implementation (maybe is better a third party lib).
 //
-bool parse_ply(std::string filename, ygl::shape *shp) {
-
-	// first, parse the header
-	std::ifstream plyFile;
-	plyFile.open(filename, std::ios::in | std::ios::binary);
+bool parse_ply(std::string filename, ygl::shape *shp, std::ostream &log, ThreadPool *pool) {
 
-	if (!plyFile.is_open())
+	// the whole file is mapped (or inflated, if compressed) and the header is
+	// read from the buffer
+	InputBuffer input(filename);
+	if (!input.is_open()) {
+		if (input.is_compressed())
+			log << "[File: " + filename + "]: " << "Corrupt or unsupported compressed file.\n";
 		return false;
+	}
+	size_t pos = 0;
 	// current line read
 	std::string line;
 
-	// read float from 4bytes
-	auto readFloat = [&plyFile]() {
-		char buff[4];
-		plyFile.read(buff, 4);
-		return  *((float *)buff);
-	};
-
 	// we are interested in vertices and faces (for now)
-	// number of vertices (equivalent to shape.pos)
-	int n_vertices = 0;
-	// per vertex properties name
-	std::vector<std::string> vertex_prop{};
-	// faces (triangles)
-	int n_faces = 0;
-	int n_vert_per_face = 0;
-	// list of elements present (should be only vertices and faces)
-	std::vector<std::string> elements;
-	bool is_asc = false;
+	PlyHeader header;
 	auto errMsgStart = "[File: " + filename + "]: ";
-	std::getline(plyFile, line);
+	bool readLine = read_header_line(input, pos, line);
 
 	while (true) {
 		if (ygl::startswith(line, "end_header"))
 			break;
-		if (ygl::startswith(line, "format") && ygl::contains(line, "ascii")) {
-			is_asc = true;
-			std::getline(plyFile, line);
+		if (!readLine) {
+			log << errMsgStart << "Unexpected end of file reading the header.\n";
+			return false;
+		}
+		if (ygl::startswith(line, "format")) {
+			header.ascii = ygl::contains(line, "ascii");
+			header.bigEndian = ygl::contains(line, "binary_big_endian");
+			readLine = read_header_line(input, pos, line);
 			continue;
 		}
 		if (ygl::startswith(line, "element")) {
 			auto tokens = split(line, " \r\n");
 			// get name
 			if (tokens[1] == "vertex") {
-				elements.push_back("vertex");
-				n_vertices = atoi(tokens[2].c_str());
+				header.elements.push_back("vertex");
+				header.n_vertices = atoi(tokens[2].c_str());
 				// read properties
-				std::getline(plyFile, line);
+				readLine = read_header_line(input, pos, line);
 				while (ygl::startswith(line, "property")) {
 					auto prop_tokens = split(line, " \r\n");
-					if (prop_tokens[1] != "float") {
-						std::cerr << errMsgStart << "unexpected type (!= float) for vertex property.\n";
+					PlyType type = prop_tokens.size() == 3 ? parse_ply_type(prop_tokens[1]) : PlyType::Unknown;
+					if (type == PlyType::Unknown) {
+						log << errMsgStart << "unexpected type " << (prop_tokens.size() > 1 ? prop_tokens[1] : "") << " for vertex property.\n";
 						return false;
 					}
-					// memorize name of property
-					vertex_prop.push_back(prop_tokens[2]);
-					std::getline(plyFile, line);
+					// memorize name and type of property
+					header.vertexProps.push_back(PlyProperty{ prop_tokens[2], type });
+					readLine = read_header_line(input, pos, line);
 				}
 			}
 			else if (tokens[1] == "face") {
-				elements.push_back("face");
-				n_faces = atoi(tokens[2].c_str());
+				header.elements.push_back("face");
+				header.n_faces = atoi(tokens[2].c_str());
 				// read properties
-				std::getline(plyFile, line);
+				readLine = read_header_line(input, pos, line);
 				while (ygl::startswith(line, "property")) {
 					auto prop_tokens = split(line, " \r\n");
-					if (prop_tokens[2] != "uint8" && prop_tokens[2] != "uchar") {
-						std::cerr << errMsgStart << "expected type uint8 or uchar for list of vertex indexes' size, but got " << prop_tokens[2] << ".\n";
+					if (prop_tokens.size() != 5 || prop_tokens[1] != "list") {
+						log << errMsgStart << "Expected a list of vertex indexes as face property.\n";
+						return false;
+					}
+					header.faceCountType = parse_ply_type(prop_tokens[2]);
+					header.faceIndexType = parse_ply_type(prop_tokens[3]);
+					if (!is_integer_type(header.faceCountType)) {
+						log << errMsgStart << "expected an integer type for list of vertex indexes' size, but got " << prop_tokens[2] << ".\n";
 						return false;
 					}
-					if (prop_tokens[3] != "int") {
-						std::cerr << errMsgStart << "Expected type int for vertex indexes\n";
+					if (!is_integer_type(header.faceIndexType)) {
+						log << errMsgStart << "Expected an integer type for vertex indexes\n";
 						return false;
 					}
-					if (prop_tokens[4] != "vertex_indices") {
-						std::cerr << errMsgStart << "Expected vertex_indices property, got " << prop_tokens[4] << " instead.\n";
+					if (prop_tokens[4] != "vertex_indices" && prop_tokens[4] != "vertex_index") {
+						log << errMsgStart << "Expected vertex_indices property, got " << prop_tokens[4] << " instead.\n";
 						return false;
 					}
-					std::getline(plyFile, line);
+					readLine = read_header_line(input, pos, line);
 				}
 			}
 			else {
-				std::cerr << errMsgStart << "Element " << tokens[1] << " not known.\n";
+				log << errMsgStart << "Element " << tokens[1] << " not known.\n";
 				return false;
 			}
 		}
 		else {
-			std::getline(plyFile, line);
+			readLine = read_header_line(input, pos, line);
 		}
 	}
-	// After the header, now parse the values
-	for (auto elem : elements) {
-		if (elem == "vertex") {
-			for (int v = 0; v < n_vertices; v++) {
-				// boolean values that tells whether those properties are 
-				// found in the list of properties for a vertex
-				bool bpos = false;
-				bool buv = false;
-				bool bnorm = false;
-
-				ygl::vec3f pos, norm;
-				ygl::vec2f uv;
-
-				if (is_asc) {
-					std::getline(plyFile, line);
-					auto vals = split(line, " \r\n");
-					int count = 0;
-					for (auto prop : vertex_prop) {
-						if (prop == "x") {
-							bpos = true;
-							pos.x = atof(vals[count++].c_str());
-						}
-						else if (prop == "y") {
-							pos.y = atof(vals[count++].c_str());
-						}
-						else if (prop == "z") {
-							pos.z = atof(vals[count++].c_str());
-						}
-						else if (prop == "nx") {
-							norm.x = atof(vals[count++].c_str());
-						}
-						else if (prop == "ny") {
-							norm.y = atof(vals[count++].c_str());
-						}
-						else if (prop == "nz") {
-							norm.z = atof(vals[count++].c_str());
-						}
-						else if (prop == "u") {
-							uv.x = atof(vals[count++].c_str());
-						}
-						else if (prop == "v") {
-							uv.y = atof(vals[count++].c_str());
-						}
-						else {
-							std::cerr << "Value " << prop << " is not a recognized property of vertex.\n";
-							return false;
-						}
-					}
-				}
-				else {
-					// read binary
-					for (auto prop : vertex_prop) {
-						if (prop == "x") {
-							bpos = true;
-							pos.x = readFloat();
-						}
-						else if (prop == "y") {
-							pos.y = readFloat();
-						}
-						else if (prop == "z") {
-							pos.z = readFloat();
-						}
-						else if (prop == "nx") {
-							bnorm = true;
-							norm.x = readFloat();
-						}
-						else if (prop == "ny") {
-							norm.y = readFloat();
-						}
-						else if (prop == "nz") {
-							norm.z = readFloat();
-						}
-						else if (prop == "u") {
-							buv = true;
-							uv.x = readFloat();
-						}
-						else if (prop == "v") {
-							uv.y = readFloat();
-						}
-						else {
-							std::cerr << "Value " << prop << " is not a recognized property of vertex.\n";
-							return false;
-						}
-					}
-				}
-				if (!bpos) {
-					std::cerr << errMsgStart << "No vertex positions\n";
-					return false;
-				}
-				shp->pos.push_back(pos);
-				if (bnorm)
-					shp->norm.push_back(norm);
-				if (buv)
-					shp->texcoord.push_back(uv);
-			}
-		}
-		else if (elem == "face") {
-			for (int f = 0; f < n_faces; f++) {
-				if (is_asc) {
-					std::getline(plyFile, line);
-					auto vals = split(line, " \r\n");
-					if (vals[0] != "3") {
-						// only triangles for now
-						std::cerr << errMsgStart << "There must be only three vertices per face. Got " << vals[0] << " instead.\n";
-						return false;
-					}
-					ygl::vec3i triangle = { atoi(vals[1].c_str()), atoi(vals[2].c_str()), atoi(vals[3].c_str()) };
-					shp->triangles.push_back(triangle);
-				}
-				else {
-					ygl::vec3i triangle;
-
-					char buff1[1];
-					plyFile.read(buff1, 1);
-					unsigned char n_v = (unsigned char)buff1[0];
-					if (n_v != 3) {
-						std::cerr << errMsgStart << "There must be only three vertices per face. Got " << n_v << " instead.\n";
-						return false;
-					}
-					char buff[4];
-					plyFile.read(buff, 4);
-					triangle.x = *((int *)buff);
-
-					plyFile.read(buff, 4);
-					triangle.y = *((int *)buff);
-
-					plyFile.read(buff, 4);
-					triangle.z = *((int *)buff);
-
-					shp->triangles.push_back(triangle);
-				}
-			}
-		}
-		else {
-			std::cerr << errMsgStart << "Element '" << elem << "' not recognized.\n";
-			return false;
-		}
-	}
-	plyFile.close();
-	return true;
+	header.dataStart = pos;
+	if (header.ascii)
+		return parse_ply_ascii(filename, input, header, shp, log, pool);
+	return parse_ply_binary(filename, input, header, shp, log);
 }
@@ -9,6 +9,7 @@
 #include <locale>
 #include <vector>
 #include "utils.h"
+#include "ThreadPool.h"
 
 #define YGL_IMAGEIO_IMPLEMENTATION 1
 #define YGL_OPENGL 0
@@ -18,7 +19,10 @@
 // parse_ply
 // Parse a PLY file format and fills a shape structure (must be altready allocated).
 // Note: works for binary and ascii, but only when faces and vertex elements are present.
+// Quads are kept as quads, larger polygons are split in triangles.
 // TODO: a less ugly implementation (maybe is better a third party lib).
+// Error messages are written to log. Big ascii files are decoded in parallel
+// on the pool, if one is given.
 //
-bool parse_ply(std::string filename, ygl::shape *shape);
+bool parse_ply(std::string filename, ygl::shape *shape, std::ostream &log = std::cerr, ThreadPool *pool = nullptr);
 #endif
\ No newline at end of file
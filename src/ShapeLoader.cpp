@@ -0,0 +1,282 @@
+#include "ShapeLoader.h"
+#include <sstream>
+#include <climits>
+#include <cstring>
+
+//
+// build_shape
+//
+void build_shape(ShapeJob &job, ThreadPool *pool) {
+	ygl::shape *shp = job.shp;
+	job.done = true;
+	if (!job.plyFilename.empty()) {
+		std::stringstream log;
+		if (!parse_ply(job.plyFilename, shp, log, pool)) {
+			job.failed = true;
+			job.log = log.str();
+			return;
+		}
+	}
+
+	if (job.computeNormals && shp->norm.empty())
+		my_compute_normals(shp->triangles, shp->pos, shp->norm, true, pool);
+
+	// handle texture coordinate scaling
+	for (size_t i = 0; i < shp->texcoord.size(); i++) {
+		shp->texcoord[i].x *= job.uscale;
+		shp->texcoord[i].y *= job.vscale;
+	}
+
+	if (job.weldEpsilon >= 0)
+		job.weldSavedBytes = weld_vertices(shp, job.weldEpsilon);
+
+	if (job.optimizeCache)
+		job.cacheStats = optimize_vertex_cache(shp);
+
+	// the data was just written, it is still in the caches
+	if (job.hashContent)
+		job.contentHash = hash_shape(shp);
+}
+
+//
+// for_each_buffer
+// Calls f on every buffer of two shapes that make up their content.
+//
+template <typename F>
+static bool for_each_buffer(const ygl::shape *a, const ygl::shape *b, F f) {
+	return f(a->points, b->points) && f(a->lines, b->lines) && f(a->triangles, b->triangles) &&
+		f(a->quads, b->quads) && f(a->quads_pos, b->quads_pos) && f(a->quads_norm, b->quads_norm) &&
+		f(a->quads_texcoord, b->quads_texcoord) && f(a->beziers, b->beziers) && f(a->pos, b->pos) &&
+		f(a->norm, b->norm) && f(a->texcoord, b->texcoord) && f(a->texcoord1, b->texcoord1) &&
+		f(a->color, b->color) && f(a->radius, b->radius) && f(a->tangsp, b->tangsp);
+}
+
+//
+// hash_shape
+//
+uint64_t hash_shape(const ygl::shape *shp) {
+	uint64_t h = hash_bytes(&shp->subdivision, sizeof(shp->subdivision), shp->catmullclark);
+	for_each_buffer(shp, shp, [&h](auto &buffer, auto &) {
+		h = hash_bytes(buffer.data(), buffer.size() * sizeof(buffer[0]), h);
+		return true;
+	});
+	return h;
+}
+
+//
+// same_shape
+// Values are compared bit by bit.
+//
+bool same_shape(const ygl::shape *a, const ygl::shape *b) {
+	if (a->subdivision != b->subdivision || a->catmullclark != b->catmullclark)
+		return false;
+	return for_each_buffer(a, b, [](auto &x, auto &y) {
+		return x.size() == y.size() && (x.empty() || std::memcmp(x.data(), y.data(), x.size() * sizeof(x[0])) == 0);
+	});
+}
+
+//
+// constructor
+//
+ShapeLoader::ShapeLoader(ThreadPool &pool, size_t maxLoads, size_t maxBytes) : pool(pool) {
+	this->set_limits(maxLoads, maxBytes);
+}
+
+//
+// set_limits
+//
+void ShapeLoader::set_limits(size_t maxLoads, size_t maxBytes) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->maxLoads = maxLoads ? maxLoads : this->pool.size();
+	this->maxBytes = maxBytes;
+	this->start_queued();
+}
+
+//
+// load
+//
+void ShapeLoader::load(ShapeJob *job) {
+	// the size of the decoded file stands for the memory needed to load it
+	size_t bytes = decoded_file_size(job->plyFilename);
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->queued.push_back(std::make_pair(job, bytes));
+	this->start_queued();
+}
+
+//
+// wait
+//
+void ShapeLoader::wait() {
+	std::unique_lock<std::mutex> lock(this->mutex);
+	while (this->running > 0 || !this->queued.empty()) {
+		if (!this->queued.empty() && this->has_room(this->queued.front().second)) {
+			auto next = this->queued.front();
+			this->queued.pop_front();
+			this->running++;
+			this->runningBytes += next.second;
+			lock.unlock();
+			this->run(next.first, next.second);
+			lock.lock();
+		}
+		else {
+			this->finished.wait(lock);
+		}
+	}
+}
+
+//
+// cancel
+//
+void ShapeLoader::cancel() {
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->queued.clear();
+	this->finished.wait(lock, [this]() { return this->running == 0; });
+}
+
+//
+// has_room
+//
+bool ShapeLoader::has_room(size_t bytes) const {
+	if (this->running == 0)
+		return true;
+	return this->running < this->maxLoads && this->runningBytes + bytes <= this->maxBytes;
+}
+
+//
+// start_queued
+// Submit the queued jobs to the pool, in order, while the limits allow it.
+//
+void ShapeLoader::start_queued() {
+	while (!this->queued.empty() && this->has_room(this->queued.front().second)) {
+		auto next = this->queued.front();
+		this->queued.pop_front();
+		this->running++;
+		this->runningBytes += next.second;
+		this->pool.submit([this, next]() { this->run(next.first, next.second); });
+	}
+}
+
+//
+// run
+//
+void ShapeLoader::run(ShapeJob *job, size_t bytes) {
+	try {
+		build_shape(*job, &this->pool);
+	}
+	catch (...) {
+		job->failed = true;
+	}
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->running--;
+	this->runningBytes -= bytes;
+	this->start_queued();
+	this->finished.notify_all();
+}
+
+// meshes with fewer triangles are handled by a single thread
+static const size_t parallelNormalsMinTriangles = 1 << 16;
+// big meshes are split in at most this many blocks of triangles
+static const size_t maxNormalsBlocks = 64;
+// vertices handed out at a time to the threads
+static const size_t normalsVertexBlock = 1 << 14;
+
+//
+// face_normal
+// Normal of a triangle, the way pbrt computes it.
+//
+static inline ygl::vec3f face_normal(const ygl::vec3i &t, const std::vector<ygl::vec3f> &pos, bool weighted) {
+	auto n = cross(pos[t.y] - pos[t.z], pos[t.x] - pos[t.z]); // it is different here
+	if (!weighted) n = normalize(n);
+	return n;
+}
+
+//
+// NormalsBlock
+// Sums of the normals of a block of triangles, for the range of vertices
+// [lo, hi] they use.
+//
+struct NormalsBlock {
+	size_t first, last;
+	int lo, hi;
+	std::vector<ygl::vec3f> sums;
+};
+
+//
+// my_compute_normals
+// because pbrt computes it differently
+// TODO: must be removed in future.
+// Big meshes are split in blocks of consecutive triangles, that sum their
+// normals on the pool in buffers of their own. Triangles close in the list
+// usually share close vertices, so the buffers only cover the range of
+// vertices used by the block. Then every vertex adds up the sums of the blocks
+// in order. The blocks depend only on the mesh, so the result does not depend
+// on the number of threads; it can differ from the serial sum only in the last
+// bits of the vertices shared by two blocks. When the ranges are too wide
+// (the vertices are scattered), the serial loop is used.
+//
+void my_compute_normals(const std::vector<ygl::vec3i>& triangles,
+	const std::vector<ygl::vec3f>& pos, std::vector<ygl::vec3f>& norm, bool weighted, ThreadPool *pool) {
+	size_t nverts = pos.size();
+	size_t ntris = triangles.size();
+	std::vector<NormalsBlock> blocks;
+	if (pool && pool->size() > 1 && ntris >= parallelNormalsMinTriangles) {
+		size_t blockSize = std::max(parallelNormalsMinTriangles / 4, (ntris + maxNormalsBlocks - 1) / maxNormalsBlocks);
+		blocks.resize((ntris + blockSize - 1) / blockSize);
+		pool->parallel_for(blocks.size(), [&](size_t b) {
+			auto &block = blocks[b];
+			block.first = b * blockSize;
+			block.last = std::min(ntris, block.first + blockSize);
+			block.lo = INT_MAX;
+			block.hi = INT_MIN;
+			for (size_t f = block.first; f < block.last; f++) {
+				for (auto vid : triangles[f]) {
+					block.lo = std::min(block.lo, vid);
+					block.hi = std::max(block.hi, vid);
+				}
+			}
+		});
+		size_t total = 0;
+		for (auto &block : blocks)
+			total += (size_t)(block.hi - block.lo + 1);
+		if (total > 2 * nverts)
+			blocks.clear();
+	}
+
+	norm.resize(nverts);
+	if (blocks.empty()) {
+		for (auto& n : norm) n = ygl::zero3f;
+		for (auto& t : triangles) {
+			auto n = face_normal(t, pos, weighted);
+			for (auto vid : t) norm[vid] += n;
+		}
+		for (auto& n : norm) n = normalize(n);
+		return;
+	}
+
+	pool->parallel_for(blocks.size(), [&](size_t b) {
+		auto &block = blocks[b];
+		block.sums.assign((size_t)(block.hi - block.lo + 1), ygl::zero3f);
+		for (size_t f = block.first; f < block.last; f++) {
+			auto &t = triangles[f];
+			auto n = face_normal(t, pos, weighted);
+			for (auto vid : t) block.sums[vid - block.lo] += n;
+		}
+	});
+	size_t vertexBlocks = (nverts + normalsVertexBlock - 1) / normalsVertexBlock;
+	pool->parallel_for(vertexBlocks, [&](size_t vb) {
+		int first = (int)(vb * normalsVertexBlock);
+		int last = (int)std::min(nverts, (vb + 1) * normalsVertexBlock);
+		// blocks using some vertex of this range
+		std::vector<const NormalsBlock *> used;
+		for (auto &block : blocks)
+			if (block.lo < last && block.hi >= first)
+				used.push_back(&block);
+		for (int v = first; v < last; v++) {
+			auto n = ygl::zero3f;
+			for (auto block : used)
+				if (v >= block->lo && v <= block->hi)
+					n += block->sums[v - block->lo];
+			norm[v] = normalize(n);
+		}
+	});
+}
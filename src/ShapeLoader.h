@@ -0,0 +1,123 @@
+#ifndef __SHAPELOADER__
+#define __SHAPELOADER__
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include "ThreadPool.h"
+#include "PLYParser.h"
+#include "MeshOptimizer.h"
+
+//
+// ShapeJob
+// The expensive part of building a shape (loading ply files, computing normals,
+// scaling texture coordinates) is not done while parsing the directives. The
+// shape is already in the scene, with its name and material, when the job is
+// recorded.
+//
+struct ShapeJob {
+	ygl::shape *shp = nullptr;
+	// ply file to load into the shape, if any
+	std::string plyFilename = "";
+	// file and position of the Shape directive, to report a failure loading
+	// the ply file (the line is found only then)
+	std::string sourceFile = "";
+	size_t sourcePos = 0;
+	bool computeNormals = false;
+	// uv scaling of the graphics state when the shape was declared
+	float uscale = 1;
+	float vscale = 1;
+	// vertices closer than this are welded (see weld_vertices), no welding
+	// if negative. weldSavedBytes is set to the bytes removed.
+	float weldEpsilon = -1;
+	size_t weldSavedBytes = 0;
+	// reorder the elements and vertices for the vertex cache (see
+	// optimize_vertex_cache); cacheStats is set to the result
+	bool optimizeCache = false;
+	VertexCacheStats cacheStats;
+	// set when the job has been run
+	bool done = false;
+	// set when the job fails, with the messages given by the ply parser
+	bool failed = false;
+	std::string log = "";
+	// shape group and instance made for the shape, when it is not part of an
+	// object: the shape can then be merged with an identical one (see
+	// PBRTParser::dedup_shapes), using the hash of its content.
+	ygl::shape_group *group = nullptr;
+	ygl::instance *inst = nullptr;
+	bool hashContent = false;
+	uint64_t contentHash = 0;
+};
+
+//
+// build_shape
+// Run a shape job. Big meshes use the pool, if given, to compute the normals.
+//
+void build_shape(ShapeJob &job, ThreadPool *pool = nullptr);
+
+//
+// hash_shape
+// Hash of the elements and vertex data of a shape (not of its name or material).
+//
+uint64_t hash_shape(const ygl::shape *shp);
+
+//
+// same_shape
+// True if two shapes have exactly the same elements and vertex data.
+//
+bool same_shape(const ygl::shape *a, const ygl::shape *b);
+
+//
+// ShapeLoader
+// Runs the jobs of plymesh shapes on the thread pool while the parser goes on
+// with the directives, so reading and decoding the ply files overlaps with the
+// lexing. At most maxLoads jobs run at the same time, and jobs are started only
+// while the total decoded size of the files being loaded (see decoded_file_size)
+// stays within maxBytes (a job bigger than that runs alone). The other jobs wait
+// in a queue.
+//
+class ShapeLoader {
+public:
+	// maxLoads = 0 means one load per pool thread
+	ShapeLoader(ThreadPool &pool, size_t maxLoads = 0, size_t maxBytes = (size_t)1 << 30);
+
+	void set_limits(size_t maxLoads, size_t maxBytes);
+
+	// start the job as soon as the limits allow it. The job must stay at the
+	// same address until it is done.
+	void load(ShapeJob *job);
+
+	// returns when all the jobs given to load() are done. The calling thread
+	// runs queued jobs too.
+	void wait();
+
+	// drop the queued jobs and wait for the running ones
+	void cancel();
+
+private:
+	ThreadPool &pool;
+	size_t maxLoads;
+	size_t maxBytes;
+
+	std::mutex mutex;
+	std::condition_variable finished;
+	std::deque<std::pair<ShapeJob *, size_t>> queued;
+	size_t running = 0;
+	size_t runningBytes = 0;
+
+	// must be called holding the lock
+	bool has_room(size_t bytes) const;
+	void start_queued();
+	void run(ShapeJob *job, size_t bytes);
+};
+
+//
+// my_compute_normals
+// because pbrt computes it differently
+// TODO: must be removed in future.
+//
+void my_compute_normals(const std::vector<ygl::vec3i>& triangles,
+	const std::vector<ygl::vec3f>& pos, std::vector<ygl::vec3f>& norm, bool weighted,
+	ThreadPool *pool = nullptr);
+#endif
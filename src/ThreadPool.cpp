@@ -0,0 +1,55 @@
+#include "ThreadPool.h"
+
+//
+// constructor
+//
+ThreadPool::ThreadPool(unsigned int nthreads) {
+	if (nthreads == 0)
+		nthreads = std::thread::hardware_concurrency();
+	if (nthreads == 0)
+		nthreads = 1;
+	for (unsigned int i = 0; i < nthreads; i++)
+		this->workers.emplace_back(&ThreadPool::work, this);
+}
+
+//
+// destructor
+//
+ThreadPool::~ThreadPool() {
+	this->shutdown();
+}
+
+//
+// shutdown
+//
+void ThreadPool::shutdown() {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+		this->tasks.clear();
+	}
+	this->wakeup.notify_all();
+	for (auto &w : this->workers) {
+		if (w.joinable())
+			w.join();
+	}
+}
+
+//
+// work
+// Loop of the worker threads.
+//
+void ThreadPool::work() {
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->wakeup.wait(lock, [this]() { return this->stopping || !this->tasks.empty(); });
+			if (this->stopping)
+				return;
+			task = std::move(this->tasks.front());
+			this->tasks.pop_front();
+		}
+		task();
+	}
+}
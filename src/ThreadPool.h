@@ -0,0 +1,133 @@
+#ifndef __THREADPOOL__
+#define __THREADPOOL__
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <atomic>
+#include <algorithm>
+#include <exception>
+
+//
+// ThreadPool
+// Fixed set of worker threads executing tasks in submission order. The result
+// (or the exception) of a task is delivered through the future returned by
+// submit(). When the pool is shut down (or destroyed), queued tasks are dropped
+// (their futures get a broken promise) and the running ones are waited for.
+//
+class ThreadPool {
+public:
+	// nthreads = 0 means one thread per hardware thread
+	ThreadPool(unsigned int nthreads = 0);
+	~ThreadPool();
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	template <typename F>
+	std::future<typename std::invoke_result<F>::type> submit(F task) {
+		typedef typename std::invoke_result<F>::type R;
+		// std::function needs a copyable callable, packaged_task is not
+		auto job = std::make_shared<std::packaged_task<R()>>(std::move(task));
+		std::future<R> result = job->get_future();
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			if (!this->stopping)
+				this->tasks.push_back([job]() { (*job)(); });
+		}
+		this->wakeup.notify_one();
+		return result;
+	};
+
+	//
+	// parallel_for
+	// Calls body(i) for every i in [0, count), on the workers and on the calling
+	// thread, and returns when all the calls are done. Indices are handed out one
+	// at a time, so threads that get cheap items keep taking more while others
+	// are busy with expensive ones. It can be called by a task running on the
+	// pool: helpers that did not start before the calling thread ran out of
+	// indices are not waited for (they find nothing to do), so nested loops
+	// cannot deadlock.
+	//
+	template <typename F>
+	void parallel_for(size_t count, F body) {
+		struct State {
+			std::atomic<size_t> next{ 0 };
+			std::mutex mutex;
+			std::condition_variable idle;
+			// helpers calling body, and whether new helpers are still admitted
+			size_t running = 0;
+			bool closed = false;
+			std::exception_ptr error = nullptr;
+		};
+		auto state = std::make_shared<State>();
+		auto run = [count](State &s, F &body) {
+			for (size_t i = s.next++; i < count; i = s.next++)
+				body(i);
+		};
+		F *shared = &body;
+		// the calling thread takes the place of one worker
+		size_t nhelpers = std::min<size_t>(this->size() - 1, count > 0 ? count - 1 : 0);
+		for (size_t i = 0; i < nhelpers; i++) {
+			// late helpers only touch the state, that they keep alive: body
+			// lives in this frame.
+			this->submit([state, shared, run, count]() {
+				{
+					std::lock_guard<std::mutex> lock(state->mutex);
+					if (state->closed)
+						return;
+					state->running++;
+				}
+				try {
+					run(*state, *shared);
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> lock(state->mutex);
+					if (!state->error)
+						state->error = std::current_exception();
+					state->next = count;
+				}
+				{
+					std::lock_guard<std::mutex> lock(state->mutex);
+					state->running--;
+				}
+				state->idle.notify_all();
+			});
+		}
+		std::exception_ptr error = nullptr;
+		try {
+			run(*state, body);
+		}
+		catch (...) {
+			error = std::current_exception();
+			state->next = count;
+		}
+		// every running helper must be done before returning, they refer to this frame
+		std::unique_lock<std::mutex> lock(state->mutex);
+		state->closed = true;
+		state->idle.wait(lock, [&state]() { return state->running == 0; });
+		if (!error)
+			error = state->error;
+		if (error)
+			std::rethrow_exception(error);
+	};
+
+	unsigned int size() const { return (unsigned int)this->workers.size(); };
+
+	// stop the workers. Tasks submitted after this are dropped.
+	void shutdown();
+
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	bool stopping = false;
+
+	void work();
+};
+#endif
@@ -1,18 +1,103 @@
 
 #include "PBRTParser.h"
+#include "InstanceTable.h"
 #include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
 
 int main(int argc, char** argv){
 	
+	// optional directory where the lexemes of the scene files are cached
+	std::string cacheDirectory = "";
+	// merge identical shapes
+	bool dedup = false;
+	// vertex welding tolerance, disabled if negative
+	float weldEpsilon = -1;
+	// reorder the shapes for the vertex cache
+	bool reorder = false;
+	// optional table of the instances, written next to the output scene
+	std::string instancesFilename = "";
+	// print the parsing throughput
+	bool stats = false;
+	// limits of the background ply loads (0 loads means one per thread), the
+	// bytes are those of the decoded files
+	bool plyLimits = false;
+	size_t plyMaxLoads = 0;
+	size_t plyMaxBytes = (size_t)1 << 30;
+	while (argc >= 2) {
+		std::string option = argv[1];
+		if (option == "--cache" && argc >= 3) {
+			cacheDirectory = argv[2];
+			argc -= 2;
+			argv += 2;
+		}
+		else if (option == "--instances" && argc >= 3) {
+			instancesFilename = argv[2];
+			argc -= 2;
+			argv += 2;
+		}
+		else if (option == "--weld" && argc >= 3) {
+			weldEpsilon = std::max(std::strtof(argv[2], nullptr), 0.0f);
+			argc -= 2;
+			argv += 2;
+		}
+		else if (option == "--ply-limits" && argc >= 4) {
+			plyLimits = true;
+			plyMaxLoads = std::strtoul(argv[2], nullptr, 10);
+			plyMaxBytes = (size_t)std::strtoul(argv[3], nullptr, 10) << 20;
+			argc -= 3;
+			argv += 3;
+		}
+		else if (option == "--reorder") {
+			reorder = true;
+			argc -= 1;
+			argv += 1;
+		}
+		else if (option == "--stats") {
+			stats = true;
+			argc -= 1;
+			argv += 1;
+		}
+		else if (option == "--dedup") {
+			dedup = true;
+			argc -= 1;
+			argv += 1;
+		}
+		else
+			break;
+	}
 	if (argc < 3)
 	{
-		printf("Usage: command <input_scene_file> <output_scene_file>\n");
+		printf("Usage: command [--cache <cache_directory>] [--dedup] [--weld <epsilon>] [--reorder] [--instances <instance_table>] [--ply-limits <max_loads> <max_decoded_megabytes>] [--stats] <input_scene_file> <output_scene_file>\n");
 		exit(1);
 	}
-	auto parser = PBRTParser(argv[1]);
 	ygl::scene *scn;
 	try {
+		auto start = std::chrono::steady_clock::now();
+		auto parser = PBRTParser(argv[1], cacheDirectory);
+		parser.set_shape_dedup(dedup);
+		parser.set_vertex_welding(weldEpsilon);
+		parser.set_vertex_cache_optimization(reorder);
+		if (plyLimits)
+			parser.set_ply_load_limits(plyMaxLoads, plyMaxBytes);
 		scn = parser.parse();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		if (stats)
+			printf("Parsed %lu directives in %.3f s (%.0f directives/s).\n", parser.get_directive_count(),
+			elapsed.count(), parser.get_directive_count() / std::max(elapsed.count(), 1e-9));
+		if (weldEpsilon >= 0)
+			printf("Vertex welding saved %zu bytes.\n", parser.get_weld_saved_bytes());
+		if (reorder) {
+			// ACMR: vertices transformed per triangle
+			double total = 0;
+			for (auto &entry : parser.get_vertex_cache_report()) {
+				printf("Reordered %s: %zu triangles, ACMR %.3f -> %.3f in %.3f s.\n", entry.first.c_str(),
+					entry.second.triangles, entry.second.acmrBefore, entry.second.acmrAfter, entry.second.seconds);
+				total += entry.second.seconds;
+			}
+			printf("Reordered %zu shapes in %.3f s.\n", parser.get_vertex_cache_report().size(), total);
+		}
 	}
 	catch (PBRTException ex) {
 		std::cout << ex.what() << std::endl;
@@ -24,6 +109,8 @@ int main(int argc, char** argv){
 		auto so = ygl::save_options();
 		so.skip_missing = false;
 		ygl::save_scene(argv[2], scn, so);
+		if (!instancesFilename.empty())
+			save_instance_table(instancesFilename, scn);
 	}
 	catch (std::exception ex) {
 		std::cout << ex.what() << "\n";
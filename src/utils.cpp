@@ -1,21 +1,617 @@
 #include "utils.h"
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
 
 //
-// read_file
-// Load a text file as a string.
+// InputBuffer
+// Map the file in memory if possible, otherwise read it.
 //
-std::string read_file(std::string filename) {
-	std::fstream inputFile;
-	inputFile.open(filename, std::ios::in);
-	std::stringstream ss;
-	std::string line;
-	while (std::getline(inputFile, line)) {
-		ss << line << "\n";
-	}
-	// set filename and path properties
-	auto textToParse = ss.str();
-	inputFile.close();
-	return textToParse;
+InputBuffer::InputBuffer(const std::string &filename, bool streaming) {
+	this->open_file(filename, streaming);
+	if (!this->inflater)
+		this->available.store(this->length, std::memory_order_release);
+}
+
+void InputBuffer::open_file(const std::string &filename, bool streaming) {
+	if (filename == "-") {
+		this->read_stream(std::cin);
+		return;
+	}
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file != INVALID_HANDLE_VALUE) {
+		LARGE_INTEGER fileSize;
+		if (GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+			HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (fileMapping) {
+				this->mapping = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+				// the view keeps a reference to the mapping object
+				CloseHandle(fileMapping);
+			}
+			if (this->mapping) {
+				this->text = (const char *)this->mapping;
+				this->length = (size_t)fileSize.QuadPart;
+				this->opened = true;
+			}
+		}
+		CloseHandle(file);
+	}
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd >= 0) {
+		struct stat st;
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+			void *addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (addr != MAP_FAILED) {
+				madvise(addr, (size_t)st.st_size, MADV_SEQUENTIAL);
+				this->mapping = addr;
+				this->text = (const char *)addr;
+				this->length = (size_t)st.st_size;
+				this->opened = true;
+			}
+		}
+		close(fd);
+	}
+#endif
+	if (!this->opened) {
+		// not a regular file (or mapping failed): fall back to reading it.
+		std::ifstream inputFile(filename, std::ios::in | std::ios::binary);
+		if (inputFile.is_open())
+			this->read_stream(inputFile);
+	}
+	if (this->opened && (!streaming || !this->stream()))
+		this->decompress();
+}
+
+InputBuffer::~InputBuffer() {
+	this->stop_inflater();
+	this->unmap();
+}
+
+void InputBuffer::unmap() {
+	if (!this->mapping)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(this->mapping);
+#else
+	munmap(this->mapping, this->length);
+#endif
+	this->mapping = nullptr;
+}
+
+//
+// StringSink
+// Output of the inflate functions (see below) growing a string. The sinks give
+// room for more text (nullptr to stop), are told how much text was produced
+// and how much of the compressed data has been read.
+//
+struct StringSink {
+	std::string &out;
+	size_t used = 0;
+
+	StringSink(std::string &out, size_t guess) : out(out) {
+		this->out.resize(guess + 1);
+	}
+	char *room(size_t &avail) {
+		if (this->used == this->out.size())
+			this->out.resize(this->out.size() * 2);
+		avail = this->out.size() - this->used;
+		return &this->out[this->used];
+	}
+	void produced(size_t n) { this->used += n; }
+	void consumed(size_t) {}
+	void finish() { this->out.resize(this->used); }
+};
+
+#ifdef USE_ZLIB
+//
+// inflate_gzip
+// Inflates a gzip (or zlib) stream, made of one or more members, into the
+// sink. Returns false if the data is corrupt or truncated, or if the sink
+// stops.
+//
+template <typename Sink>
+static bool inflate_gzip(const char *data, size_t size, Sink &sink) {
+	z_stream zs = {};
+	// 32 lets zlib detect the gzip or zlib header
+	if (inflateInit2(&zs, 15 + 32) != Z_OK)
+		return false;
+	size_t pos = 0;
+	int ret = Z_OK;
+	while (true) {
+		size_t room;
+		char *out = sink.room(room);
+		if (!out) {
+			ret = Z_MEM_ERROR;
+			break;
+		}
+		// zlib counts with 32 bit integers
+		uInt in = (uInt)std::min<size_t>(size - pos, 1u << 30);
+		uInt avail = (uInt)std::min<size_t>(room, 1u << 30);
+		zs.next_in = (Bytef *)(data + pos);
+		zs.avail_in = in;
+		zs.next_out = (Bytef *)out;
+		zs.avail_out = avail;
+		ret = inflate(&zs, Z_NO_FLUSH);
+		pos += in - zs.avail_in;
+		sink.produced(avail - zs.avail_out);
+		sink.consumed(pos);
+		if (ret == Z_STREAM_END) {
+			// concatenated members follow
+			if (pos < size && (unsigned char)data[pos] == 0x1f) {
+				inflateReset(&zs);
+				continue;
+			}
+			break;
+		}
+		if (ret != Z_OK && !(ret == Z_BUF_ERROR && zs.avail_out == 0))
+			break;
+		if (pos == size && zs.avail_out != 0)
+			break;
+	}
+	inflateEnd(&zs);
+	return ret == Z_STREAM_END;
+}
+#endif
+
+#ifdef USE_ZSTD
+//
+// inflate_zstd
+// Decompresses a zstd stream (one or more frames) into the sink.
+//
+template <typename Sink>
+static bool inflate_zstd(const char *data, size_t size, Sink &sink) {
+	ZSTD_DStream *zs = ZSTD_createDStream();
+	if (!zs)
+		return false;
+	ZSTD_inBuffer in = { data, size, 0 };
+	size_t ret = 0;
+	while (true) {
+		size_t room;
+		char *out = sink.room(room);
+		if (!out) {
+			ret = (size_t)-1;
+			break;
+		}
+		ZSTD_outBuffer outBuf = { out, room, 0 };
+		ret = ZSTD_decompressStream(zs, &outBuf, &in);
+		sink.produced(outBuf.pos);
+		sink.consumed(in.pos);
+		if (ZSTD_isError(ret))
+			break;
+		// with room left in the output, all that could be flushed has been
+		if (in.pos == in.size && outBuf.pos < outBuf.size)
+			break;
+	}
+	ZSTD_freeDStream(zs);
+	// 0 means that the last frame is complete
+	return !ZSTD_isError(ret) && ret == 0;
+}
+#endif
+
+//
+// compression_of
+// Format of the data, from its magic number.
+//
+enum class Compression { None, Gzip, Zstd };
+
+static Compression compression_of(const char *data, size_t size) {
+	const unsigned char *magic = (const unsigned char *)data;
+	if (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+		return Compression::Gzip;
+	if (size >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+		return Compression::Zstd;
+	return Compression::None;
+}
+
+//
+// inflate_data
+// Returns false if the data is corrupt, or if its format is not supported.
+//
+template <typename Sink>
+static bool inflate_data(Compression format, const char *data, size_t size, Sink &sink) {
+#ifdef USE_ZLIB
+	if (format == Compression::Gzip)
+		return inflate_gzip(data, size, sink);
+#endif
+#ifdef USE_ZSTD
+	if (format == Compression::Zstd)
+		return inflate_zstd(data, size, sink);
+#endif
+	return false;
+}
+
+//
+// inflated_size_guess
+// The gzip trailer stores the size of the text modulo 2^32, the zstd frame
+// header may store it: a good guess of the space needed, but only a guess
+// (several members or frames, big files).
+//
+static size_t gzip_size_guess(const char *trailer, size_t size) {
+	uint32_t isize = (uint32_t)(unsigned char)trailer[0] | (uint32_t)(unsigned char)trailer[1] << 8 |
+		(uint32_t)(unsigned char)trailer[2] << 16 | (uint32_t)(unsigned char)trailer[3] << 24;
+	// deflate cannot shrink data more than ~1032 times
+	return isize > size && isize / 1032 <= size ? isize : size;
+}
+
+static size_t zstd_size_guess(const char *header, size_t headerSize, size_t size) {
+#ifdef USE_ZSTD
+	unsigned long long content = ZSTD_getFrameContentSize(header, headerSize);
+	if (content != ZSTD_CONTENTSIZE_UNKNOWN && content != ZSTD_CONTENTSIZE_ERROR)
+		return (size_t)content;
+#endif
+	return 4 * size;
+}
+
+static size_t inflated_size_guess(Compression format, const char *data, size_t size) {
+	if (format == Compression::Gzip && size >= 18)
+		return gzip_size_guess(data + size - 4, size);
+#ifdef USE_ZSTD
+	if (format == Compression::Zstd)
+		return zstd_size_guess(data, size, size);
+#endif
+	return size;
+}
+
+//
+// decompress
+// The compressed data is read from the mapping (or from the owned buffer),
+// and released once the text is inflated.
+//
+void InputBuffer::decompress() {
+	Compression format = compression_of(this->text, this->length);
+	if (format == Compression::None)
+		return;
+	std::string inflated;
+	StringSink sink(inflated, inflated_size_guess(format, this->text, this->length));
+	bool ok = inflate_data(format, this->text, this->length, sink);
+	sink.finish();
+	this->unmap();
+	this->ownedText.swap(inflated);
+	this->text = this->ownedText.data();
+	this->length = this->ownedText.size();
+	this->compressed = true;
+	this->opened = ok;
+}
+
+#ifndef _WIN32
+//
+// Inflater
+// Background inflation of a compressed file (see InputBuffer::stream). The
+// text is written in chunks into an anonymous mapping reserved for the
+// largest size the compressed data can expand to: only the pages written are
+// backed by memory, and the text never moves. The pages of the compressed
+// file are released as soon as they have been read. The helper thread stays
+// at most aheadSize bytes ahead of the text asked by the reader (wait_for).
+//
+struct InputBuffer::Inflater {
+	static const size_t chunkSize = 1 << 20;
+	static const size_t releaseSize = 8 << 20;
+	static const size_t aheadSize = 16 << 20;
+
+	InputBuffer *buffer;
+	char *out = nullptr;
+	size_t capacity = 0;
+	size_t used = 0;
+	// text given back by release()
+	size_t textReleased = 0;
+	// compressed data, and the part of it already released
+	const char *in = nullptr;
+	size_t released = 0;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable progress;
+	bool finished = false;
+	// text asked by the reader, and signal of the reader asking more
+	size_t demand = 0;
+	std::condition_variable wanted;
+	bool cancelled = false;
+
+	char *room(size_t &avail) {
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->wanted.wait(lock, [this]() {
+				return this->cancelled || this->used < this->demand + aheadSize;
+			});
+			if (this->cancelled)
+				return nullptr;
+		}
+		if (this->used == this->capacity)
+			return nullptr;
+		avail = std::min(chunkSize, this->capacity - this->used);
+		return this->out + this->used;
+	}
+
+	void produced(size_t n) {
+		this->used += n;
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->buffer->available.store(this->used, std::memory_order_release);
+		}
+		this->progress.notify_all();
+	}
+
+	void consumed(size_t pos) {
+		if (!this->buffer->mapping)
+			return;
+		size_t page = (size_t)sysconf(_SC_PAGESIZE);
+		size_t end = pos / page * page;
+		if (end >= this->released + releaseSize) {
+			madvise((void *)(this->in + this->released), end - this->released, MADV_DONTNEED);
+			this->released = end;
+		}
+	}
+};
+
+//
+// stream
+// Starts inflating the text in background, if the file is compressed. Returns
+// false if it must be inflated at once instead.
+//
+bool InputBuffer::stream() {
+	Compression format = compression_of(this->text, this->length);
+	if (format == Compression::None || sizeof(void *) < 8)
+		return format == Compression::None;
+	// upper bound of the size of the text
+	size_t capacity = 0;
+#ifdef USE_ZLIB
+	if (format == Compression::Gzip)
+		capacity = this->length * 1032 + (1 << 20);
+#endif
+#ifdef USE_ZSTD
+	// a zstd block of at least 3 bytes expands to at most 128 KB
+	if (format == Compression::Zstd)
+		capacity = (this->length / 3 + 1) * ((size_t)128 << 10);
+#endif
+	// the address space is not unlimited either
+	if (capacity == 0 || capacity > ((size_t)1 << 46))
+		return false;
+	void *out = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (out == MAP_FAILED)
+		return false;
+
+	this->inflater.reset(new Inflater());
+	Inflater *inflater = this->inflater.get();
+	inflater->buffer = this;
+	inflater->out = (char *)out;
+	inflater->capacity = capacity;
+	inflater->in = this->text;
+	size_t inSize = this->length;
+	this->text = inflater->out;
+	this->compressed = true;
+	inflater->thread = std::thread([this, inflater, format, inSize]() {
+		bool ok = inflate_data(format, inflater->in, inSize, *inflater);
+		std::lock_guard<std::mutex> lock(inflater->mutex);
+		this->opened = ok;
+		inflater->finished = true;
+		inflater->progress.notify_all();
+	});
+	return true;
+}
+
+//
+// wait_for
+//
+size_t InputBuffer::wait_for(size_t size) {
+	if (!this->inflater)
+		return this->size();
+	std::unique_lock<std::mutex> lock(this->inflater->mutex);
+	if (size > this->inflater->demand) {
+		this->inflater->demand = size;
+		this->inflater->wanted.notify_one();
+	}
+	this->inflater->progress.wait(lock, [this, size]() {
+		return this->inflater->finished || this->available.load(std::memory_order_relaxed) >= size;
+	});
+	return this->size();
+}
+
+//
+// is_complete
+//
+bool InputBuffer::is_complete() {
+	if (!this->inflater)
+		return true;
+	std::lock_guard<std::mutex> lock(this->inflater->mutex);
+	return this->inflater->finished;
+}
+
+//
+// release
+//
+void InputBuffer::release(size_t end) {
+	if (!this->inflater)
+		return;
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	end = end / page * page;
+	if (end <= this->inflater->textReleased)
+		return;
+	madvise(this->inflater->out + this->inflater->textReleased, end - this->inflater->textReleased, MADV_DONTNEED);
+	this->inflater->textReleased = end;
+}
+
+//
+// stop_inflater
+//
+void InputBuffer::stop_inflater() {
+	if (!this->inflater)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(this->inflater->mutex);
+		this->inflater->cancelled = true;
+	}
+	this->inflater->wanted.notify_one();
+	this->inflater->thread.join();
+	munmap(this->inflater->out, this->inflater->capacity);
+	this->inflater.reset();
+}
+#else
+// no background inflation on windows
+struct InputBuffer::Inflater {};
+bool InputBuffer::stream() { return false; }
+size_t InputBuffer::wait_for(size_t) { return this->size(); }
+bool InputBuffer::is_complete() { return true; }
+void InputBuffer::release(size_t) {}
+void InputBuffer::stop_inflater() {}
+#endif
+
+//
+// read_stream
+// Fallback for inputs that cannot be mapped.
+//
+void InputBuffer::read_stream(std::istream &stream) {
+	const size_t chunkSize = 1 << 20;
+	size_t used = 0;
+	while (stream) {
+		this->ownedText.resize(used + chunkSize);
+		stream.read(&this->ownedText[used], chunkSize);
+		used += (size_t)stream.gcount();
+	}
+	this->ownedText.resize(used);
+	this->text = this->ownedText.data();
+	this->length = used;
+	this->opened = true;
+}
+
+//
+// Arena::allocate_block
+// Moves the arena to the next block, that is created if it is missing or too
+// small for the request.
+//
+void *Arena::allocate_block(size_t bytes) {
+	size_t next = this->blocks.empty() ? 0 : this->current + 1;
+	if (next >= this->blocks.size() || this->blocks[next].size < bytes) {
+		size_t size = bytes > this->blockSize ? bytes : this->blockSize;
+		this->blocks.insert(this->blocks.begin() + next, Block{ std::unique_ptr<char[]>(new char[size]), size });
+	}
+	this->current = next;
+	this->offset = bytes;
+	return this->blocks[next].data.get();
+}
+
+//
+// hash_bytes
+//
+static const uint64_t hashPrime1 = 11400714785074694791ull;
+static const uint64_t hashPrime2 = 14029467366897019727ull;
+static const uint64_t hashPrime3 = 1609587929392839161ull;
+static const uint64_t hashPrime4 = 9650029242287828579ull;
+static const uint64_t hashPrime5 = 2870177450012600261ull;
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t load64(const unsigned char *p) {
+	uint64_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t input) {
+	acc += input * hashPrime2;
+	acc = rotl64(acc, 31);
+	return acc * hashPrime1;
+}
+
+static inline uint64_t hash_merge(uint64_t acc, uint64_t lane) {
+	acc ^= hash_round(0, lane);
+	return acc * hashPrime1 + hashPrime4;
+}
+
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed) {
+	const unsigned char *p = (const unsigned char *)data;
+	const unsigned char *end = p + size;
+	uint64_t h;
+	if (size >= 32) {
+		uint64_t v1 = seed + hashPrime1 + hashPrime2;
+		uint64_t v2 = seed + hashPrime2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - hashPrime1;
+		for (; end - p >= 32; p += 32) {
+			v1 = hash_round(v1, load64(p));
+			v2 = hash_round(v2, load64(p + 8));
+			v3 = hash_round(v3, load64(p + 16));
+			v4 = hash_round(v4, load64(p + 24));
+		}
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h = hash_merge(h, v1);
+		h = hash_merge(h, v2);
+		h = hash_merge(h, v3);
+		h = hash_merge(h, v4);
+	}
+	else {
+		h = seed + hashPrime5;
+	}
+	h += (uint64_t)size;
+	for (; end - p >= 8; p += 8)
+		h = rotl64(h ^ hash_round(0, load64(p)), 27) * hashPrime1 + hashPrime4;
+	for (; p < end; p++)
+		h = rotl64(h ^ (*p * hashPrime5), 11) * hashPrime1;
+	h ^= h >> 33;
+	h *= hashPrime2;
+	h ^= h >> 29;
+	h *= hashPrime3;
+	h ^= h >> 32;
+	return h;
+}
+
+//
+// file_size
+//
+size_t file_size(const std::string &filename) {
+	std::error_code err;
+	auto size = std::filesystem::file_size(filename, err);
+	return err ? 0 : (size_t)size;
+}
+
+//
+// decoded_file_size
+// Only the magic number and the size stored in the gzip trailer or in the
+// zstd frame header are read (see inflated_size_guess). Without them, a
+// compression ratio of 4 is assumed.
+//
+size_t decoded_file_size(const std::string &filename) {
+	size_t size = file_size(filename);
+	std::ifstream in(filename, std::ios::in | std::ios::binary);
+	char header[18] = {};
+	in.read(header, sizeof(header));
+	size_t headerSize = (size_t)in.gcount();
+	Compression format = compression_of(header, headerSize);
+	if (format == Compression::Gzip) {
+		char trailer[4];
+		in.clear();
+		in.seekg(size - sizeof(trailer));
+		if (size >= 18 && in.read(trailer, sizeof(trailer)))
+			return gzip_size_guess(trailer, size);
+		return 4 * size;
+	}
+	if (format == Compression::Zstd)
+		return zstd_size_guess(header, headerSize, size);
+	return size;
 }
 
 //
@@ -5,12 +5,162 @@
 #include <cctype>
 #include <fstream>
 #include <sstream>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
 
 //
-// read_file
-// Load a text file as a string.
+// InputBuffer
+// Read-only view of the whole content of a file. Regular files are memory-mapped
+// and scanned in place, so no copy of the text is ever made. Pipes, character
+// devices and the standard input (filename "-") cannot be mapped: in that case the
+// data is read in big chunks into a buffer owned by the object.
+// Files compressed with gzip (or zstd, when the library is available) are
+// recognized by their magic number and inflated into the owned buffer, reading
+// the compressed data from the mapping. Corrupt or unsupported compressed files
+// are reported as not open.
+// With streaming set, compressed files are instead inflated in chunks by a
+// helper thread: data() is valid at once, size() grows as the text is
+// inflated, and a failure is only known when the text is complete.
 //
-std::string read_file(std::string filename);
+class InputBuffer {
+public:
+	InputBuffer(const std::string &filename, bool streaming = false);
+	~InputBuffer();
+	// the buffer owns the mapping, so it cannot be copied.
+	InputBuffer(const InputBuffer &) = delete;
+	InputBuffer &operator=(const InputBuffer &) = delete;
+
+	const char *data() const { return this->text; }
+	// bytes of the text available so far
+	size_t size() const { return this->available.load(std::memory_order_acquire); }
+	// waits until size bytes are available or the text is complete, and
+	// returns the available bytes
+	size_t wait_for(size_t size);
+	// true once the whole text is available (always, without streaming)
+	bool is_complete();
+	// gives back the memory of the text before end, which must not be read
+	// anymore (only with streaming)
+	void release(size_t end);
+	// false if the file could not be opened
+	bool is_open() const { return this->opened; }
+	// true if data() points to a memory mapped file
+	bool is_mapped() const { return this->mapping != nullptr; }
+	// true if the file was compressed and data() is the inflated text
+	bool is_compressed() const { return this->compressed; }
+
+private:
+	const char *text = nullptr;
+	// size of the mapping or of the owned text
+	size_t length = 0;
+	std::atomic<size_t> available{ 0 };
+	std::atomic<bool> opened{ false };
+	// base address of the mapped view (nullptr when the fallback is used)
+	void *mapping = nullptr;
+	bool compressed = false;
+	// fallback storage
+	std::string ownedText;
+	void read_stream(std::istream &stream);
+	void unmap();
+	// replace the content with its inflated text, if it is compressed
+	void decompress();
+	// background inflation of the text
+	struct Inflater;
+	std::unique_ptr<Inflater> inflater;
+	void open_file(const std::string &filename, bool streaming);
+	bool stream();
+	void stop_inflater();
+};
+
+//
+// Arena
+// Bump allocator for short lived data. Memory is taken from big blocks and it is
+// never released piece by piece: reset() makes all the blocks available again in
+// O(1), and they are reused by the next allocations. Only trivially destructible
+// objects can be allocated in the arena.
+//
+class Arena {
+public:
+	Arena(size_t blockSize = 64 * 1024) : blockSize(blockSize) {};
+	Arena(const Arena &) = delete;
+	Arena &operator=(const Arena &) = delete;
+
+	void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+		size_t start = (this->offset + alignment - 1) & ~(alignment - 1);
+		if (this->current < this->blocks.size() && start + bytes <= this->blocks[this->current].size) {
+			this->offset = start + bytes;
+			return this->blocks[this->current].data.get() + start;
+		}
+		return this->allocate_block(bytes);
+	};
+
+	template <typename T>
+	T *allocate_array(size_t n) {
+		return (T *)this->allocate(n * sizeof(T), alignof(T));
+	};
+
+	void reset() {
+		this->current = 0;
+		this->offset = 0;
+	};
+
+private:
+	struct Block {
+		std::unique_ptr<char[]> data;
+		size_t size;
+	};
+	std::vector<Block> blocks;
+	size_t blockSize;
+	// block in use and first free byte in it
+	size_t current = 0;
+	size_t offset = 0;
+	void *allocate_block(size_t bytes);
+};
+
+//
+// ArenaAllocator
+// Standard allocator drawing from an Arena, so that containers can live in it.
+// Deallocation does nothing: memory is given back when the arena is reset.
+//
+template <typename T>
+struct ArenaAllocator {
+	typedef T value_type;
+	Arena *arena;
+
+	ArenaAllocator(Arena *arena) : arena(arena) {};
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {};
+
+	T *allocate(size_t n) { return this->arena->allocate_array<T>(n); };
+	void deallocate(T *, size_t) {};
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U> &other) const { return this->arena == other.arena; };
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U> &other) const { return this->arena != other.arena; };
+};
+
+//
+// hash_bytes
+// 64 bit hash of a block of memory, in the style of xxHash64: four lanes of
+// 8 bytes are mixed in parallel, so long buffers are hashed at memory speed.
+// The seed lets the hashes of several buffers be chained.
+//
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed = 0);
+
+//
+// file_size
+// Size in bytes of a file, 0 if it cannot be read.
+//
+size_t file_size(const std::string &filename);
+
+//
+// decoded_file_size
+// Size of a file once inflated, if it is compressed (a guess, since the file
+// is not inflated), its size otherwise.
+//
+size_t decoded_file_size(const std::string &filename);
 
 //
 // split